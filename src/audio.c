@@ -15,26 +15,161 @@
 	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
 */
 #include "audio.h"
+#include "channelf.h"
 
 #include <string.h>
 
-#include "sintable.h"
+// amp multiplier per sample at 44.1khz is 0.998, scaled to the other
+// rates so the tone fades out in the same time
+#define LN_DECAY -0.0020020026706730793 // ln(0.998)
 
-int16_t AUDIO_Buffer[735 * 2 * 2];
+// The tones are square waves of 1000, 500 and 120 Hz. All are multiples
+// of 20 Hz, so the phase of a tone is kept in samples of a 20 Hz cycle,
+// which each tone steps through this many times per cycle.
+static const unsigned int toneSteps[4] = { 0, 50, 25, 6 };
 
-uint8_t AUDIO_tone = 0; // current tone
+// Correction for the step of a square wave, t is the phase past the step
+// in cycles and dt the phase advance per sample (PolyBLEP). Rounds the
+// step over the samples either side of it, taking most of the aliasing
+// of a naive square wave out of the audible band.
+static float polyBLEP(float t, float dt)
+{
+	if(t < dt)
+	{
+		t /= dt;
+		return t + t - t * t - 1.0f;
+	}
+	if(t > 1.0f - dt)
+	{
+		t = (t - 1.0f) / dt;
+		return t * t + t + t + 1.0f;
+	}
+	return 0.0f;
+}
 
-static const int samplesPerFrame = 735; // sampleRate / framesPerSecond
+void AUDIO_setRate(struct channelf *ctx, unsigned int rate)
+{
+	double x = LN_DECAY * 44100 / rate;
+	int amp;
+	int i;
 
-unsigned int AUDIO_sampleInCycle = 0; // time since start of tone, resets to 0 after every full cycle
-#define FULL_AMPLITUDE 16384
-int16_t AUDIO_amp = FULL_AMPLITUDE; // tone amplitude (16384 = full)
-static const float decay = 0.998; // multiplier for amp per sample
+	ctx->AUDIO_Rate = rate;
+	// 0.998^(44100/rate) from the start of the series for e^x, x is tiny
+	ctx->AUDIO_Decay = (float)(1.0 + x + x * x / 2 + x * x * x / 6);
+
+	// amp is rounded down every sample, so the fade is looked up rather
+	// than worked out, which also spares a float conversion per sample
+	for(amp=0; amp<=FULL_AMPLITUDE; amp++)
+	{
+		ctx->AUDIO_Fade[amp] = (int)(amp * ctx->AUDIO_Decay);
+	}
+	for(amp=0; amp<=FULL_AMPLITUDE; amp++)
+	{
+		int faded = amp;
+
+		for(i=0; i<8; i++)
+			faded = ctx->AUDIO_Fade[faded];
+		ctx->AUDIO_Fade8[amp] = faded;
+	}
+}
 
-unsigned int AUDIO_ticks = 0; // unprocessed ticks in 1/100 of tick
-static int sample = 0; // current sample buffer position
+// amp after count samples
+static int fade(struct channelf *ctx, int amp, int count)
+{
+	for(; count >= 8 && amp; count -= 8)
+		amp = ctx->AUDIO_Fade8[amp];
+	for(; count > 0 && amp; count--)
+		amp = ctx->AUDIO_Fade[amp];
+	return amp;
+}
 
-void AUDIO_portReceive(uint8_t port, uint8_t val)
+// Add count samples of the current tone to the frame. Samples past the
+// end of the buffer, or all of them when muted, are dropped, but still
+// move the tone along.
+static void renderSamples(struct channelf *ctx, int count)
+{
+	int16_t *out = &ctx->AUDIO_Buffer[2 * ctx->AUDIO_sample];
+	int output = ctx->AUDIO_Muted ? 0 : AUDIO_MAX_SAMPLES - ctx->AUDIO_sample;
+	int amp = ctx->AUDIO_amp;
+	const unsigned int period = ctx->AUDIO_Rate / 20; // samples in a 20 Hz cycle
+	unsigned int cycle = ctx->AUDIO_sampleInCycle;
+	int i;
+
+	if(output > count)
+		output = count;
+	if(output < 0)
+		output = 0;
+
+	if(ctx->AUDIO_tone==0 || amp==0) // silence
+	{
+		memset(out, 0, output * 2 * sizeof(int16_t));
+		amp = fade(ctx, amp, count);
+	}
+	else
+	{
+		const unsigned int step = toneSteps[ctx->AUDIO_tone];
+		const float dt = (float)step / period; // tone cycles per sample
+		unsigned int phase = (cycle * step) % period;
+
+		for(i=0; i<output; i++)
+		{
+			float t = (float)phase / period;
+			float square = t < 0.5f ? 1.0f : -1.0f;
+			int res;
+
+			square += polyBLEP(t, dt);
+			square -= polyBLEP(t < 0.5f ? t + 0.5f : t - 0.5f, dt);
+			res = (int)(square * amp * 0.5f);
+			out[2*i] = res;
+			out[2*i+1] = res;
+			amp = ctx->AUDIO_Fade[amp];
+			phase += step;
+			if(phase >= period) phase -= period;
+		}
+		amp = fade(ctx, amp, count - output);
+	}
+
+	ctx->AUDIO_amp = amp;
+	ctx->AUDIO_sampleInCycle = (cycle + count) % period;
+	ctx->AUDIO_sample += count;
+}
+
+// Render the samples due by ticks into the frame. A tick is
+// CRYSTAL_PER_TICK * rate / CRYSTAL_HZ samples, the remainder is carried
+// to the next call so the rate is exact over any number of frames.
+static void renderTo(struct channelf *ctx, int ticks)
+{
+	uint64_t elapsed;
+	int count;
+
+	if(ticks <= ctx->AUDIO_rendered)
+	{
+		return;
+	}
+	elapsed = ctx->AUDIO_ticks + (uint64_t)(ticks - ctx->AUDIO_rendered) * CRYSTAL_PER_TICK * ctx->AUDIO_Rate;
+	count = (int)(elapsed / CRYSTAL_HZ);
+
+	ctx->AUDIO_ticks = (unsigned int)(elapsed - (uint64_t)count * CRYSTAL_HZ);
+	ctx->AUDIO_rendered = ticks;
+	renderSamples(ctx, count);
+}
+
+// Render the frame up to each logged tone change and make the change
+static void renderEvents(struct channelf *ctx)
+{
+	int i;
+
+	for(i=0; i<ctx->AUDIO_EventCount; i++)
+	{
+		renderTo(ctx, ctx->AUDIO_Events[i].ticks);
+		ctx->AUDIO_tone = ctx->AUDIO_Events[i].tone;
+		ctx->AUDIO_amp = FULL_AMPLITUDE;
+		ctx->AUDIO_sampleInCycle = 0;
+	}
+	ctx->AUDIO_EventCount = 0;
+}
+
+void AUDIO_portReceive(struct channelf *ctx, uint8_t port, uint8_t val)
 {
 	if(port==5)
 	{
@@ -43,77 +178,53 @@ void AUDIO_portReceive(uint8_t port, uint8_t val)
 		// 1 - 1000hz
 		// 2 - 500hz
 		// 3 - 120hz
-		
+		// Changes are logged with their time and rendered with the frame,
+		// or when the log fills up.
+		struct audio_event *event;
+		uint8_t tone = ctx->AUDIO_EventCount ? ctx->AUDIO_Events[ctx->AUDIO_EventCount-1].tone : ctx->AUDIO_tone;
+
 		val = (val&0xC0)>>6;
-		if(val!=AUDIO_tone)
+		if(val!=tone)
 		{
-			AUDIO_tone = val;
-			AUDIO_amp = FULL_AMPLITUDE;
-			AUDIO_sampleInCycle=0;
+			if(ctx->AUDIO_EventCount==AUDIO_EVENTS)
+			{
+				renderEvents(ctx);
+			}
+			event = &ctx->AUDIO_Events[ctx->AUDIO_EventCount++];
+			event->ticks = ctx->CPU_Ticks - ctx->CPU_Ticks_Debt;
+			event->tone = val;
 		}
 	}
 }
 
-void AUDIO_tick(int dt) // dt = ticks elapsed since last call
+void AUDIO_frame(struct channelf *ctx, int ticks)
 {
-	// an audio frame lasts ~14914 ticks
-	// at 44.1khz, there are 735 samples per frame
-	// ~20.29 ticks per sample (14913.15 ticks/frame)
-	
-	AUDIO_ticks += dt * 100;
+	renderEvents(ctx);
+	renderTo(ctx, ticks - ctx->CPU_Ticks_Debt);
 
-	while(AUDIO_ticks>2029)
+	// the frame holds the samples its ticks took, which varies with the
+	// instructions run and the rate
+	ctx->AUDIO_Samples = ctx->AUDIO_sample < AUDIO_MAX_SAMPLES ? ctx->AUDIO_sample : AUDIO_MAX_SAMPLES;
+	if(ctx->AUDIO_Muted)
 	{
-		AUDIO_ticks-=2029;
-		
-		AUDIO_Buffer[sample] = 0;
-		if(sample<samplesPerFrame) // output sample
-		{
-			int toneOutput = 0;
-			int res;
-			// sintable is a 20Hz tone, we need to speed it up to 1000, 500, 120 or 240 Hz
-			switch (AUDIO_tone) {
-			case 1:
-				toneOutput = 2 * sintable[(AUDIO_sampleInCycle * 50) % SINSAMPLES];
-				break;
-			case 2:
-				toneOutput = 2 * sintable[(AUDIO_sampleInCycle * 25) % SINSAMPLES];
-				break;
-			case 3:
-				toneOutput = sintable[(AUDIO_sampleInCycle * 6) % SINSAMPLES];
-				toneOutput += sintable[(AUDIO_sampleInCycle * 12) % SINSAMPLES];
-				break;
-			}
-
-			res = (toneOutput * AUDIO_amp) / 100000;
-			AUDIO_Buffer[2 * sample] = res;
-			AUDIO_Buffer[2 * sample + 1] = res;
-		}
-		
-		AUDIO_amp *= decay;
-		sample++;
-
-		// generate tones //
-		AUDIO_sampleInCycle++;
-		// All tones are multiples of 20 Hz
-		AUDIO_sampleInCycle %= SINSAMPLES;
+		ctx->AUDIO_Samples = 0;
 	}
-}
 
-void AUDIO_frame(void)
-{
 	// start a new audio frame
-	memset(AUDIO_Buffer, 0, sizeof(AUDIO_Buffer));
-	sample = 0;
+	ctx->AUDIO_sample = 0;
+	ctx->AUDIO_rendered = 0;
 }
 
-void AUDIO_reset(void)
+void AUDIO_reset(struct channelf *ctx)
 {
-	memset(AUDIO_Buffer, 0, sizeof(AUDIO_Buffer));
+	memset(ctx->AUDIO_Buffer, 0, sizeof(ctx->AUDIO_Buffer));
 
 	// reset tone generator
-	AUDIO_tone = 0;
+	ctx->AUDIO_tone = 0;
 
 	// start a new audio frame
-	sample = 0;
+	ctx->AUDIO_sample = 0;
+	ctx->AUDIO_Samples = 0;
+	ctx->AUDIO_EventCount = 0;
+	ctx->AUDIO_rendered = 0;
 }
@@ -19,18 +19,37 @@
 
 #include <stdint.h>
 
-extern int16_t AUDIO_Buffer[735 * 2 * 2];
-extern uint8_t AUDIO_tone;
-extern int16_t AUDIO_amp;
-extern unsigned int AUDIO_sampleInCycle;
-extern unsigned int AUDIO_ticks;
+struct channelf;
 
-void AUDIO_tick(int ticks);
+#define FULL_AMPLITUDE 16384
 
-void AUDIO_frame(void);
+#define AUDIO_EVENTS 64 // tone changes held until the end of the frame
 
-void AUDIO_reset(void);
+#define AUDIO_MAX_SAMPLES 1024 // per frame, room for 48khz and frames that overrun
 
-void AUDIO_portReceive(uint8_t port, uint8_t val);
+#define AUDIO_DEFAULT_RATE 44100
+
+// a write to the tone port, ticks into the frame
+struct audio_event
+{
+	int ticks;
+	uint8_t tone;
+};
+
+// AUDIO_amp is 0 to FULL_AMPLITUDE, any other amplitude is taken as full
+#define AUDIO_AMP(amp) ((amp) >= 0 && (amp) <= FULL_AMPLITUDE ? (amp) : FULL_AMPLITUDE)
+
+// Render the samples of the frame that ran up to ticks into AUDIO_Buffer,
+// from the tone changes logged during the frame. With AUDIO_Muted set
+// the tones move on as if rendered, but no samples are written and
+// AUDIO_Samples is 0.
+void AUDIO_frame(struct channelf *ctx, int ticks);
+
+void AUDIO_reset(struct channelf *ctx);
+
+// Output rate in Hz, a multiple of 20 such as 32000, 44100 or 48000
+void AUDIO_setRate(struct channelf *ctx, unsigned int rate);
+
+void AUDIO_portReceive(struct channelf *ctx, uint8_t port, uint8_t val);
 
 #endif
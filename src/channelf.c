@@ -14,6 +14,7 @@
 	You should have received a copy of the GNU General Public License
 	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
 */
+#include <string.h>
 #include "libretro.h"
 #include "channelf.h"
 #include "memory.h"
@@ -22,36 +23,66 @@
 #include "f2102.h"
 #include "ports.h"
 #include "video.h"
+#include "state.h"
+#include "profile.h"
 
-int CPU_Ticks_Debt = 0;
+#ifdef FREECHAF_PROFILE
+struct profile Profile;
+#endif
 
-void CHANNELF_run(void) // run for one frame
+void CHANNELF_run(struct channelf *ctx) // run for one frame
 {
-	int tick  = 0;
-	int ticks = CPU_Ticks_Debt;
+	int ticks = ctx->CPU_Ticks_Debt;
 
-	while(ticks<TICKS_PER_FRAME)
+	PROFILE_BEGIN(PROFILE_CPU);
+	if(ctx->F8_Core==F8_CORE_TABLE)
 	{
-		tick = F8_exec();
-		ticks+=tick;
-		AUDIO_tick(tick);
+		while(ticks<TICKS_PER_FRAME)
+		{
+			ctx->CPU_Ticks = ticks;
+			ticks += F8_exec(ctx);
+		}
 	}
+	else
+	{
+		ticks = F8_run(ctx, ticks, TICKS_PER_FRAME, 0);
+	}
+	PROFILE_END(PROFILE_CPU);
+
+	// the sound written during the frame
+	PROFILE_BEGIN(PROFILE_AUDIO);
+	AUDIO_frame(ctx, ticks);
+	PROFILE_END(PROFILE_AUDIO);
+
+	ctx->CPU_Ticks_Debt = ticks - TICKS_PER_FRAME;
+}
+
+void CHANNELF_init(struct channelf *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	STATE_init(ctx);
+	ctx->F8_Flags.r = FLAGS_EXPLICIT;
+	ctx->VIDEO_Color = 2;
+	VIDEO_invalidate(ctx);
+	ctx->AUDIO_amp = FULL_AMPLITUDE;
+	AUDIO_setRate(ctx, AUDIO_DEFAULT_RATE);
+	ctx->cursorX = 4; /* initial cursor setting 'Start'  */
+	VIDEO_setOutput(ctx, VIDEO_XRGB8888, 3);
 
-	CPU_Ticks_Debt = ticks - TICKS_PER_FRAME;
+	CHANNELF_reset(ctx);
 }
 
-void CHANNELF_init(void)
+void CHANNELF_deinit(struct channelf *ctx)
 {
-	F8_init();
-	CHANNELF_reset();
+	MEMORY_unloadCartROM(ctx);
 }
 
-void CHANNELF_reset(void)
+void CHANNELF_reset(struct channelf *ctx)
 {
-	CPU_Ticks_Debt = 0;
-	MEMORY_reset();
-	F2102_reset();
-	F8_reset();
-	AUDIO_reset();
-	PORTS_reset();
+	ctx->CPU_Ticks_Debt = 0;
+	MEMORY_reset(ctx);
+	F2102_reset(ctx);
+	F8_reset(ctx);
+	AUDIO_reset(ctx);
+	PORTS_reset(ctx);
 }
@@ -1,3 +1,5 @@
+#ifndef CHANNELF_H
+#define CHANNELF_H
 /*
 	This file is part of FreeChaF.
 
@@ -15,17 +17,160 @@
 	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
 */
 
+#include <stdint.h>
 #include "libretro.h"
+#include "f8.h"
+#include "video.h"
+#include "audio.h"
+#include "channelf_hle.h"
 
 extern retro_environment_t Environ;
 extern retro_log_printf_t log_cb;
 
-extern int CPU_Ticks_Debt;
+#define MEMORY_SIZE 0x10000
+// sl131253 - 0x000 - 0x3FF
+// sl131254 - 0x400 - 0x7FF
+// cart     - 0x800 - 0x1FFF
+// vram     - 0x2000 ...
 
-void CHANNELF_run(void);
+// The address space is mapped in 256 byte pages. A page points at the
+// memory backing it and writes to ROM pages go to a scratch page. NULL
+// entries (pages split between ROM and RAM, the multicart bank
+// register) go through the slow path.
+#define MEMORY_PAGE_SHIFT 8
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGES (MEMORY_SIZE >> MEMORY_PAGE_SHIFT)
 
-void CHANNELF_init(void);
+#define R_SIZE 64
 
-void CHANNELF_reset(void);
+// One emulated Channel F. Everything a running machine touches lives
+// here, so independent machines can run side by side, each on its own
+// thread. Fields keep the names of the globals they replaced and are
+// owned by the module that prefixes them.
+struct channelf
+{
+	// CPU
+	uint8_t F8_R[R_SIZE]; // 64 byte Scratchpad
+	uint8_t F8_A; // Accumulator
+	uint16_t F8_PC0; // Program Counter
+	uint16_t F8_PC1; // Program Counter alternate
+	uint16_t F8_DC0; // Data Counter
+	uint16_t F8_DC1; // Data Counter alternate
+	uint8_t F8_ISAR; // Indirect Scratchpad Address Register (6-bit)
+	struct f8_flags F8_Flags; // Status Register, see F8_getW/F8_setW
+	int F8_Core; // F8_CORE_*
+	int CPU_Ticks_Debt; // ticks the last frame overran, the tick count the next one starts at
+	int CPU_Ticks; // tick count of the frame at the last port write
+
+	// Memory
+	uint8_t Memory[MEMORY_SIZE];
+	int MEMORY_RAMStart;
+	uint8_t MEMORY_Multicart;
+	int SysROMEnd; // MEMORY_RAMStart without a cart
+	uint8_t *ROM;
+	uint32_t ROMSize;
+	int ROMMapped; // ROM is a mapping of the cart file rather than malloc'd
+	int is_multicart;
+	// ROM offset of the selected multicart bank, ORed with the cart address.
+	// Bit 12 (bank bit 5) overlaps the address, which mirrors a 4K window.
+	// Images are always 256K, so every bank lies inside ROM.
+	uint32_t BankOffset;
+	uint8_t *MEMORY_ReadMap[MEMORY_PAGES];
+	uint8_t *MEMORY_WriteMap[MEMORY_PAGES];
+	uint8_t WriteSink[MEMORY_PAGE_SIZE]; // target for writes to ROM pages
+	uint32_t MEMORY_Written[MEMORY_PAGES]; // STATE_Epoch of the last write to each page
+
+	// IO Ports
+	uint8_t Ports[64];
+
+	// Video
+	uint8_t VIDEO_Buffer_raw[VIDEO_SIZE]; // 128x64
+	uint8_t VIDEO_ARM;
+	uint8_t VIDEO_X;
+	uint8_t VIDEO_Y;
+	uint8_t VIDEO_Color;
+	uint64_t VIDEO_Dirty; // bit per row of VIDEO_Buffer_raw changed since the last VIDEO_drawFrame
+	uint32_t VIDEO_Written[VIDEO_HEIGHT]; // STATE_Epoch of the last change to each row
+	// output picked by VIDEO_setOutput
+	void (*VIDEO_convertRow)(const uint8_t *raw, const uint32_t *rowColors, void *out);
+	const uint32_t *VIDEO_Colors; // the 8 colors in the output format
+	unsigned int VIDEO_PixelBytes;
+	unsigned int VIDEO_Scale;
+
+	// 2102 SRAM
+	uint16_t f2102_state;
+	uint8_t f2102_memory[1024];
+	uint16_t f2102_address;
+	uint8_t f2102_rw;
+	uint32_t f2102_Written; // STATE_Epoch of the last write to f2102_memory
+
+	// Audio
+	int16_t AUDIO_Buffer[AUDIO_MAX_SAMPLES * 2];
+	int AUDIO_Samples; // stereo samples in AUDIO_Buffer for the last frame
+	int AUDIO_Muted; // frames nobody hears, see AUDIO_frame
+	unsigned int AUDIO_Rate; // output rate in Hz
+	float AUDIO_Decay; // multiplier for amp per sample
+	int16_t AUDIO_Fade[FULL_AMPLITUDE + 1]; // amp one sample later
+	int16_t AUDIO_Fade8[FULL_AMPLITUDE + 1]; // amp eight samples later
+	uint8_t AUDIO_tone; // current tone
+	int16_t AUDIO_amp; // tone amplitude (16384 = full)
+	unsigned int AUDIO_sampleInCycle; // time since start of tone, resets to 0 after every full cycle
+	unsigned int AUDIO_ticks; // part of a sample not rendered yet, in 1/CRYSTAL_HZ of a sample
+	int AUDIO_sample; // current sample buffer position
+	struct audio_event AUDIO_Events[AUDIO_EVENTS]; // tone changes not rendered yet
+	int AUDIO_EventCount;
+	int AUDIO_rendered; // ticks of the frame rendered so far
+
+	// Controllers and console buttons
+	uint8_t CONTROLLER_State[3];
+	unsigned char ControllerEnabled;
+	unsigned char ControllerSwapped;
+	int cursorX;
+	int cursorDown;
+
+	struct hle_state_s hle_state;
+
+	// Savestates. Writes to RAM, VRAM and the 2102 record the epoch they
+	// happened in, which STATE_mark moves on, so incremental saves can
+	// tell what changed since a state was taken.
+	uint32_t STATE_Epoch;
+	uint32_t STATE_Instance; // tag of this machine's fixed states, see STATE_init
+	// STATE_hash keeps a hash of every RAM page, VRAM row and the 2102,
+	// redone for those written after STATE_HashMark
+	uint64_t STATE_PageHash[MEMORY_PAGES];
+	uint64_t STATE_RowHash[VIDEO_HEIGHT];
+	uint64_t STATE_2102Hash;
+	uint64_t STATE_BulkHash; // XOR of the three above
+	uint32_t STATE_HashMark; // 0 for none kept
+	int STATE_HashRAMStart; // MEMORY_RAMStart they were taken with
+
+	// On-Screen Display
+	void *Frame;
+	enum video_format DisplayFormat;
+	unsigned int DisplayWidth;
+	unsigned int DisplayHeight;
+	unsigned int DisplayPitch; // pixels from one line of Frame to the next
+	unsigned int DisplaySize;
+	uint32_t DisplayColor[2]; // in DisplayFormat
+};
+
+void CHANNELF_run(struct channelf *ctx);
+
+// Clear ctx and power it on. The BIOS and cart are loaded afterwards.
+// F8_init must have been called once before.
+void CHANNELF_init(struct channelf *ctx);
+
+// Release the cart and anything else allocated for ctx
+void CHANNELF_deinit(struct channelf *ctx);
+
+void CHANNELF_reset(struct channelf *ctx);
 
 #define TICKS_PER_FRAME 14914
+
+// Ticks run at a quarter of the 3.579545MHz NTSC color crystal, the F8
+// clock being half of it and a tick two F8 clocks: 894886.25 ticks and
+// 60.0031 frames per second
+#define CRYSTAL_HZ 3579545
+#define CRYSTAL_PER_TICK 4
+
+#endif
@@ -27,8 +27,7 @@
 #include "ports.h"
 #include "video.h"
 #include "channelf_hle.h"
-
-#define TICKS_PER_ROW 18606
+#include "profile.h"
 
 // Old MSVC has no snprintf
 #if defined(_MSC_VER) && _MSC_VER < 1900
@@ -37,12 +36,12 @@
 #define any_snprintf snprintf
 #endif
 
-void unsupported_hle_function(void)
+void unsupported_hle_function(struct channelf *ctx)
 {
 	char formatted[1024];
 	struct retro_message msg;
 	memset(formatted, 0, sizeof(formatted));
-	any_snprintf(formatted, 1000, "Unsupported HLE function: 0x%x\n", F8_PC0);
+	any_snprintf(formatted, 1000, "Unsupported HLE function: 0x%x\n", ctx->F8_PC0);
 	log_cb(RETRO_LOG_ERROR, formatted);
 	msg.msg    = formatted;
 	msg.frames = 600;
@@ -50,139 +49,141 @@ void unsupported_hle_function(void)
 	Environ(RETRO_ENVIRONMENT_SHUTDOWN, NULL);
 }
 
-static void hle_clear_row(int row)
+static void hle_clear_row(struct channelf *ctx, int row)
 {
-	memset(VIDEO_Buffer_raw + (row << 7), hle_state.screen_clear_color, 125);
-	VIDEO_Buffer_raw[(row << 7) + 125] = 0;
-	VIDEO_Buffer_raw[(row << 7) + 126] = hle_state.screen_clear_pal;
-	VIDEO_Buffer_raw[(row << 7) + 127] = 0;
+	memset(ctx->VIDEO_Buffer_raw + (row << 7), ctx->hle_state.screen_clear_color, 125);
+	ctx->VIDEO_Buffer_raw[(row << 7) + 125] = 0;
+	ctx->VIDEO_Buffer_raw[(row << 7) + 126] = ctx->hle_state.screen_clear_pal;
+	ctx->VIDEO_Buffer_raw[(row << 7) + 127] = 0;
+	ctx->VIDEO_Dirty |= VIDEO_ROW(row);
+	ctx->VIDEO_Written[row] = ctx->STATE_Epoch;
 }
 
-static int CHANNELF_HLE(void)
+static int CHANNELF_HLE(struct channelf *ctx)
 {
-	if (hle_state.screen_clear_row)
+	if (ctx->hle_state.screen_clear_row)
 	{
-		hle_clear_row(hle_state.screen_clear_row++);
-		if (hle_state.screen_clear_row == 64)
+		hle_clear_row(ctx, ctx->hle_state.screen_clear_row++);
+		if (ctx->hle_state.screen_clear_row == 64)
 		{
-			hle_state.screen_clear_row = 0;
+			ctx->hle_state.screen_clear_row = 0;
 		}
 		return TICKS_PER_ROW;
 	}
-	if (hle_state.delay_counter) {
-		hle_state.delay_counter--;
+	if (ctx->hle_state.delay_counter) {
+		ctx->hle_state.delay_counter--;
 		return 2563;
 	}
-	switch (F8_PC0)
+	switch (ctx->F8_PC0)
 	{
 	case 0x0: // init
-		memset (F8_R, 0, sizeof(F8_R));
-		if (MEMORY_read8(0x800) == 0x55)
+		memset (ctx->F8_R, 0, sizeof(ctx->F8_R));
+		if (MEMORY_read8(ctx, 0x800) == 0x55)
 		{
-			F8_A = 0x55;
-			F8_DC0 = 0x801;
-			F8_PC0 = 0x802;
-			F8_R[0x3b] = 0x28;
-			F8_ISAR = 0x3b;
+			ctx->F8_A = 0x55;
+			ctx->F8_DC0 = 0x801;
+			ctx->F8_PC0 = 0x802;
+			ctx->F8_R[0x3b] = 0x28;
+			ctx->F8_ISAR = 0x3b;
 			return 1459;
 		}
 
-		unsupported_hle_function();
+		unsupported_hle_function(ctx);
 		return 14914;
 	case 0x8f: // delay
 	{
-		uint8_t delay = F8_R[5];
-		F8_R[5] = 0;
-		F8_R[6] = 0;
-		F8_A = 0xff;
-		F8_PC0 = F8_PC1;
-		hle_state.delay_counter = delay;
+		uint8_t delay = ctx->F8_R[5];
+		ctx->F8_R[5] = 0;
+		ctx->F8_R[6] = 0;
+		ctx->F8_A = 0xff;
+		ctx->F8_PC0 = ctx->F8_PC1;
+		ctx->hle_state.delay_counter = delay;
 		return 10;
 	}
 	case 0xd0: // screen clear
 	{
 		// guesswork
-		switch (F8_R[3])
+		switch (ctx->F8_R[3])
 		{
 		case 0xd0:
 		case 0xc6:
-			hle_state.screen_clear_pal = 3;
-			hle_state.screen_clear_color = 0;
+			ctx->hle_state.screen_clear_pal = 3;
+			ctx->hle_state.screen_clear_color = 0;
 			break;
 		case 0x21:
-			hle_state.screen_clear_pal = 0;
-			hle_state.screen_clear_color = 0;
+			ctx->hle_state.screen_clear_pal = 0;
+			ctx->hle_state.screen_clear_color = 0;
 			break;
 		default:
-			unsupported_hle_function ();
+			unsupported_hle_function(ctx);
 			return TICKS_PER_FRAME;
 		}
 
-		F8_PC0 = F8_PC1;
+		ctx->F8_PC0 = ctx->F8_PC1;
 
-		if (hle_state.fast_screen_clear)
+		if (ctx->hle_state.fast_screen_clear)
 		{
 			int row;
 			for(row=0; row<64; row++)
-				hle_clear_row(row);
+				hle_clear_row(ctx, row);
 			return TICKS_PER_FRAME;
 		}
 
-		hle_clear_row(0);
-		hle_state.screen_clear_row = 1;
+		hle_clear_row(ctx, 0);
+		ctx->hle_state.screen_clear_row = 1;
 		
 		return TICKS_PER_ROW;
 	}
 	case 0x107: // pushk
 	{
-		int tisar = F8_R[0x3b];
-		F8_R[tisar & 0x3f] = F8_R[12];
-		F8_R[(tisar + 1) & 0x3f] = F8_R[13];
-		F8_R[0x3b] = (tisar + 2) & 0x3f;
+		int tisar = ctx->F8_R[0x3b];
+		ctx->F8_R[tisar & 0x3f] = ctx->F8_R[12];
+		ctx->F8_R[(tisar + 1) & 0x3f] = ctx->F8_R[13];
+		ctx->F8_R[0x3b] = (tisar + 2) & 0x3f;
 
 		// Simulate clobbering
-		F8_A = F8_ISAR;
-		F8_R[7] = F8_ISAR;
+		ctx->F8_A = ctx->F8_ISAR;
+		ctx->F8_R[7] = ctx->F8_ISAR;
 
 		// Return
-		F8_PC0 = F8_PC1;
+		ctx->F8_PC0 = ctx->F8_PC1;
 		return 48;
 	}
 	case 0x11e: // popk
 	{
-		int tisar = F8_R[0x3b];
-		F8_R[13] = F8_R[(tisar - 1) & 0x3f];
-		F8_R[12] = F8_R[(tisar - 2) & 0x3f];
-		F8_R[0x3b] = (tisar - 2) & 0x3f;
+		int tisar = ctx->F8_R[0x3b];
+		ctx->F8_R[13] = ctx->F8_R[(tisar - 1) & 0x3f];
+		ctx->F8_R[12] = ctx->F8_R[(tisar - 2) & 0x3f];
+		ctx->F8_R[0x3b] = (tisar - 2) & 0x3f;
 
 		// Simulate clobbering
-		F8_A = F8_ISAR;
-		F8_R[7] = F8_ISAR;
+		ctx->F8_A = ctx->F8_ISAR;
+		ctx->F8_R[7] = ctx->F8_ISAR;
 
 		// Return
-		F8_PC0 = F8_PC1;
+		ctx->F8_PC0 = ctx->F8_PC1;
 		return 50;
 	}
 	default:
-		unsupported_hle_function();
+		unsupported_hle_function(ctx);
 		return TICKS_PER_FRAME;
 	}
 }
 
-static int is_hle(void)
+static int is_hle(struct channelf *ctx)
 {
-	if (hle_state.screen_clear_row || hle_state.delay_counter)
+	if (ctx->hle_state.screen_clear_row || ctx->hle_state.delay_counter)
 		return 1;
 
-	if (F8_PC0 < 0x400 && hle_state.psu1_hle)
+	if (ctx->F8_PC0 < 0x400 && ctx->hle_state.psu1_hle)
 		return 1;
 
-	if (F8_PC0 >= 0x400 && F8_PC0 < 0x800 && hle_state.psu2_hle)
+	if (ctx->F8_PC0 >= 0x400 && ctx->F8_PC0 < 0x800 && ctx->hle_state.psu2_hle)
 	{
 		return 1;
 	}
 
-	if (F8_PC0 == 0xd0 && hle_state.fast_screen_clear && (F8_R[3] == 0xc6 || F8_R[3] == 0x21 || F8_R[3] == 0xd0))
+	if (ctx->F8_PC0 == 0xd0 && ctx->hle_state.fast_screen_clear && (ctx->F8_R[3] == 0xc6 || ctx->F8_R[3] == 0x21 || ctx->F8_R[3] == 0xd0))
 	{
 		return 1;
 	}
@@ -190,20 +191,30 @@ static int is_hle(void)
 	return 0;
 }
 
-void CHANNELF_HLE_run(void) // run for one frame
+void CHANNELF_HLE_run(struct channelf *ctx) // run for one frame
 {
 	int tick  = 0;
-	int ticks = CPU_Ticks_Debt;
+	int ticks = ctx->CPU_Ticks_Debt;
 
+	PROFILE_BEGIN(PROFILE_CPU);
 	while(ticks<TICKS_PER_FRAME)
 	{
-		if (is_hle())
-			tick = CHANNELF_HLE();
-		else
-			tick = F8_exec();
+		ctx->CPU_Ticks = ticks;
+		if (is_hle(ctx))
+			tick = CHANNELF_HLE(ctx);
+		else if (ctx->F8_Core == F8_CORE_TABLE)
+			tick = F8_exec(ctx);
+		else if (ctx->F8_PC0 < 0x800) // BIOS, may need HLE after every instruction
+			tick = F8_run(ctx, ticks, ticks + 1, 0) - ticks;
+		else // cart, run until it calls into the BIOS
+			tick = F8_run(ctx, ticks, TICKS_PER_FRAME, 0x800) - ticks;
 		ticks+=tick;
-		AUDIO_tick(tick);
 	}
+	PROFILE_END(PROFILE_CPU);
+
+	PROFILE_BEGIN(PROFILE_AUDIO);
+	AUDIO_frame(ctx, ticks);
+	PROFILE_END(PROFILE_AUDIO);
 
-	CPU_Ticks_Debt = ticks - TICKS_PER_FRAME;
+	ctx->CPU_Ticks_Debt = ticks - TICKS_PER_FRAME;
 }
@@ -18,9 +18,14 @@
 	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
 */
 
-void CHANNELF_HLE_run(void);
+struct channelf;
 
-void unsupported_hle_function(void);
+// the longest step an emulated BIOS call takes, so the most a frame overruns
+#define TICKS_PER_ROW 18606
+
+void CHANNELF_HLE_run(struct channelf *ctx);
+
+void unsupported_hle_function(struct channelf *ctx);
 
 struct hle_state_s
 {
@@ -33,6 +38,4 @@ struct hle_state_s
 	uint8_t delay_counter;
 };
 
-extern struct hle_state_s hle_state;
-
 #endif
@@ -21,19 +21,15 @@
 
 #include <stdio.h>
 
-uint8_t CONTROLLER_State[] = {0,0,0};
-unsigned char ControllerEnabled = 0;
-
 #define Console 0
 #define ControlA 1
 #define ControlB 2
 
 static const uint8_t ConsolePort = 0;
-#define ControlAPort (ControllerSwapped ? 4 : 1)
-#define ControlBPort (ControllerSwapped ? 1 : 4)
-unsigned char ControllerSwapped = 0;
+#define ControlAPort (ctx->ControllerSwapped ? 4 : 1)
+#define ControlBPort (ctx->ControllerSwapped ? 1 : 4)
 
-void setButton(int control, int button, int pressed)
+void setButton(struct channelf *ctx, int control, int button, int pressed)
 {
    /*
    // Console 
@@ -54,87 +50,84 @@ void setButton(int control, int button, int pressed)
    */
 
    if(pressed)
-      CONTROLLER_State[control] |= 1<<button;
+      ctx->CONTROLLER_State[control] |= 1<<button;
    else
-      CONTROLLER_State[control] &= (1<<button)^0xFF;
+      ctx->CONTROLLER_State[control] &= (1<<button)^0xFF;
 }
 
-void CONTROLLER_setInput(int control, int state)
+void CONTROLLER_setInput(struct channelf *ctx, int control, int state)
 {
 	if(control>=0 && control<=2)
-		CONTROLLER_State[control] = state;
+		ctx->CONTROLLER_State[control] = state;
 }
 
-void CONTROLLER_swap(void)
+void CONTROLLER_swap(struct channelf *ctx)
 {
-	ControllerSwapped ^= 1;
+	ctx->ControllerSwapped ^= 1;
 }
 
-int CONTROLLER_swapped(void)
+int CONTROLLER_swapped(struct channelf *ctx)
 {
-	return ControllerSwapped;
+	return ctx->ControllerSwapped;
 }
 
-int CONTROLLER_portRead(uint8_t port)
+int CONTROLLER_portRead(struct channelf *ctx, uint8_t port)
 {
 	if(port==ConsolePort)
-		 return (CONTROLLER_State[Console]^0xFF) & 0x0F;
-	if(ControllerEnabled)
+		 return (ctx->CONTROLLER_State[Console]^0xFF) & 0x0F;
+	if(ctx->ControllerEnabled)
    {
       if(port==ControlAPort)
-         return(CONTROLLER_State[ControlA]^0xFF);
+         return(ctx->CONTROLLER_State[ControlA]^0xFF);
       if(port==ControlBPort)
-         return(CONTROLLER_State[ControlB]^0xFF);
+         return(ctx->CONTROLLER_State[ControlB]^0xFF);
    }
 	return 0;
 }
 
-void CONTROLLER_portReceive(uint8_t port, uint8_t val)
+void CONTROLLER_portReceive(struct channelf *ctx, uint8_t port, uint8_t val)
 {
 	if(port==ConsolePort) // Console
-		ControllerEnabled = (val&0x40)==0;
+		ctx->ControllerEnabled = (val&0x40)==0;
 }
 
 /* Console buttons */
 
-int cursorX    = 4; /* initial cursor setting 'Start'  */
-int cursorDown = 0;
-
-void CONTROLLER_consoleInput(int action, int pressed)
+void CONTROLLER_consoleInput(struct channelf *ctx, int action, int pressed)
 {
 	switch(action)
 	{
 		case 0:
          if(pressed)
-            cursorX--;
+            ctx->cursorX--;
          break;
 		case 1:
          if(pressed)
-            cursorX++;
+            ctx->cursorX++;
          break;
 		case 2:
-			cursorDown = pressed;
-			if(cursorX==0)
+			ctx->cursorDown = pressed;
+			if(ctx->cursorX==0)
          {
             if(pressed)
-               CHANNELF_reset();
+               CHANNELF_reset(ctx);
          }
 			else
-				setButton(0, cursorX-1, pressed);
+				setButton(ctx, 0, ctx->cursorX-1, pressed);
 			break;
 	}
 
-	if (cursorX<0)
-      cursorX = 4;
-	if (cursorX>4)
-      cursorX = 0;
+	if (ctx->cursorX<0)
+      ctx->cursorX = 4;
+	if (ctx->cursorX>4)
+      ctx->cursorX = 0;
 }
 
-int CONTROLLER_cursorPos(void)
+int CONTROLLER_cursorPos(struct channelf *ctx)
 {
-	return cursorX;
+	return ctx->cursorX;
 }
-int CONTROLLER_cursorDown(void)
+int CONTROLLER_cursorDown(struct channelf *ctx)
 {
-	return cursorDown;
+	return ctx->cursorDown;
 }
@@ -19,26 +19,22 @@
 
 #include <stdint.h>
 
-void CONTROLLER_portReceive(uint8_t port, uint8_t val);
+struct channelf;
 
-int CONTROLLER_portRead(uint8_t port);
+void CONTROLLER_portReceive(struct channelf *ctx, uint8_t port, uint8_t val);
 
-void CONTROLLER_setInput(int control, int state);
+int CONTROLLER_portRead(struct channelf *ctx, uint8_t port);
 
-void CONTROLLER_swap(void);
+void CONTROLLER_setInput(struct channelf *ctx, int control, int state);
 
-void CONTROLLER_consoleInput(int control, int state);
+void CONTROLLER_swap(struct channelf *ctx);
 
-int CONTROLLER_cursorPos(void);
+void CONTROLLER_consoleInput(struct channelf *ctx, int control, int state);
 
-int CONTROLLER_cursorDown(void);
+int CONTROLLER_cursorPos(struct channelf *ctx);
 
-int CONTROLLER_swapped(void);
+int CONTROLLER_cursorDown(struct channelf *ctx);
 
-extern unsigned char ControllerEnabled;
-extern unsigned char ControllerSwapped;
-extern int cursorX;
-extern int cursorDown;
-extern uint8_t CONTROLLER_State[3];
+int CONTROLLER_swapped(struct channelf *ctx);
 
 #endif
@@ -17,64 +17,62 @@
 
 #include <string.h>
 #include "f2102.h"
+#include "channelf.h"
 #include "ports.h"
 
 
-uint16_t f2102_state = 0;
-uint8_t f2102_memory[1024];
-uint16_t f2102_address = 0;
-uint8_t f2102_rw = 0;
-
-void F2102_portReceive(uint8_t port, uint8_t val)
+void F2102_portReceive(struct channelf *ctx, uint8_t port, uint8_t val)
 {
 	switch(port)
 	{
 		case 0x20:
 		case 0x24:
-			f2102_state = (f2102_state & 0xFF) | (val<<8);
+			ctx->f2102_state = (ctx->f2102_state & 0xFF) | (val<<8);
 
-			f2102_rw = val & 1; //read/write bit = val bit 0
+			ctx->f2102_rw = val & 1; //read/write bit = val bit 0
 
-			f2102_address = f2102_address & 0x3F3; // clear address bits 2, 3
-			f2102_address = f2102_address | (val & 0x04); // address bit 2 = val bit 2
-			f2102_address = f2102_address | ((val & 0x02)<<2); // address bit 3 = val bit 1
+			ctx->f2102_address = ctx->f2102_address & 0x3F3; // clear address bits 2, 3
+			ctx->f2102_address = ctx->f2102_address | (val & 0x04); // address bit 2 = val bit 2
+			ctx->f2102_address = ctx->f2102_address | ((val & 0x02)<<2); // address bit 3 = val bit 1
 
-			if(f2102_rw==0) // read/write bit = 0-read, 1-write
+			if(ctx->f2102_rw==0) // read/write bit = 0-read, 1-write
 			{
 				// read - output bit in state bit 15 (port 24 bit 7)
-				f2102_state = (f2102_state & 0x7FFF) | (f2102_memory[f2102_address]<<15);
+				ctx->f2102_state = (ctx->f2102_state & 0x7FFF) | (ctx->f2102_memory[ctx->f2102_address]<<15);
 			}
 			else
 			{
 				// write
-				f2102_memory[f2102_address] = (val>>3) & 1; // data = val bit 3
+				ctx->f2102_memory[ctx->f2102_address] = (val>>3) & 1; // data = val bit 3
+				ctx->f2102_Written = ctx->STATE_Epoch;
 			}
 		break;
 		
 		case 0x21:
 		case 0x25:
-			f2102_state = (f2102_state & 0xFF00) | (val);
+			ctx->f2102_state = (ctx->f2102_state & 0xFF00) | (val);
 			
-			f2102_address = f2102_address & 0x0C; // clear all, save bits 2, 3
+			ctx->f2102_address = ctx->f2102_address & 0x0C; // clear all, save bits 2, 3
 			// set bits 9,8,7 to val bits 7,6,5
-			f2102_address = f2102_address | ((val & 0xE0)<<2);
+			ctx->f2102_address = ctx->f2102_address | ((val & 0xE0)<<2);
 			// set bits 6,5,4 to val bits 3,2,1
-			f2102_address = f2102_address | ((val & 0x0E)<<3);
+			ctx->f2102_address = ctx->f2102_address | ((val & 0x0E)<<3);
 			// set bit 1 to val bit 4
-			f2102_address = f2102_address | ((val&0x10)>>3);
+			ctx->f2102_address = ctx->f2102_address | ((val&0x10)>>3);
 			// set bit 0 to val bit 0
-			f2102_address = f2102_address | (val & 1);
+			ctx->f2102_address = ctx->f2102_address | (val & 1);
 		break;
 	}
 	
 	//poll
-	PORTS_write(0x24, f2102_state>>8);
-	PORTS_write(0x25, f2102_state & 0xFF);
+	PORTS_write(ctx, 0x24, ctx->f2102_state>>8);
+	PORTS_write(ctx, 0x25, ctx->f2102_state & 0xFF);
 }
 
-void F2102_reset(void)
+void F2102_reset(struct channelf *ctx)
 {
-	f2102_state = 0;
-	f2102_address = 0;
-	memset (f2102_memory, 0, sizeof(f2102_memory));
+	ctx->f2102_state = 0;
+	ctx->f2102_address = 0;
+	memset (ctx->f2102_memory, 0, sizeof(ctx->f2102_memory));
+	ctx->f2102_Written = ctx->STATE_Epoch;
 }
@@ -19,13 +19,10 @@
 
 #include <stdint.h>
 
-void F2102_portReceive(uint8_t port, uint8_t val);
+struct channelf;
 
-void F2102_reset(void);
+void F2102_portReceive(struct channelf *ctx, uint8_t port, uint8_t val);
 
-extern uint16_t f2102_state;
-extern uint8_t f2102_memory[1024];
-extern uint16_t f2102_address;
-extern uint8_t f2102_rw;
+void F2102_reset(struct channelf *ctx);
 
 #endif
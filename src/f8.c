@@ -21,22 +21,14 @@
 // http://seanriddle.com/chanfinfo.html
 
 #include <string.h>
+#include <retro_inline.h>
 
 #include "f8.h"
 #include "memory.h"
 #include "ports.h"
+#include "profile.h"
 
-uint8_t F8_R[64]; // 64 byte Scratchpad
-
-uint8_t F8_A   = 0; // Accumulator
-uint16_t F8_PC0 = 0; // Program Counter
-uint16_t F8_PC1 = 0; // Program Counter alternate
-uint16_t F8_DC0 = 0; // Data Counter
-uint16_t F8_DC1 = 0; // Data Counter alternate
-uint8_t F8_ISAR = 0; // Indirect Scratchpad Address Register (6-bit)
-uint8_t F8_W   = 0; // Status Register (flags)
-
-int (*OpCodes[0x100])(uint8_t);
+static int (*OpCodes[0x100])(struct channelf *ctx, uint8_t);
 
 // Flags
 enum
@@ -56,93 +48,90 @@ enum
 
 
 // Read 1-byte instruction operand
-uint8_t readOperand8(void)
+uint8_t readOperand8(struct channelf *ctx)
 {
-	return MEMORY_read8(F8_PC0++);
+	return MEMORY_read8(ctx, ctx->F8_PC0++);
 }
 // Read 2-byte instruction operand
-uint16_t readOperand16(void)
+uint16_t readOperand16(struct channelf *ctx)
 {
-	uint16_t val = MEMORY_read16(F8_PC0);
-	F8_PC0+=2;
+	uint16_t val = MEMORY_read16(ctx, ctx->F8_PC0);
+	ctx->F8_PC0+=2;
 	return val;
 }
 
-// Set specific flag
-void setFlag(int flag, int val)
+// Record an ALU operation, flags are derived from it on demand
+static INLINE void setResult(struct f8_flags *f, uint8_t a, uint8_t b, uint16_t r)
 {
-	F8_W = F8_W | 1<<flag;
-	F8_W = F8_W ^ 1<<flag;
-	F8_W = F8_W | (val>0)<<flag;
-	F8_W ^= (flag==0); // Compliment sign flag (1-positive, 0-negative)
+	f->a = a;
+	f->b = b;
+	f->r = r;
 }
 
-// Set zero and sign flags based on val, clear overflow and carry 
-void setFlags_0z0s(uint8_t val) // O Z C S
+// Materialise W
+static INLINE uint8_t getW(const struct f8_flags *f)
 {
-	setFlag(flag_Overflow, 0);
-	setFlag(flag_Zero, (val==0));
-	setFlag(flag_Carry, 0);
-	setFlag(flag_Sign, (val & 0x80)>0);
+	uint8_t r = f->r;
+
+	if(f->r & FLAGS_EXPLICIT) { return f->w; }
+
+	return (f->w & 0xF0) |
+		((r & 0x80)==0)<<flag_Sign | // Compliment sign flag (1-positive, 0-negative)
+		((f->r>>8)&1)<<flag_Carry |
+		(r==0)<<flag_Zero |
+		(((f->a ^ r) & (f->b ^ r))>>7)<<flag_Overflow;
 }
 
-// Clear all flags
-void clearFlags_ozcs(void)
+// Load W, all flags are taken as given
+static INLINE void setW(struct f8_flags *f, uint8_t w)
 {
-	setFlag(flag_Overflow, 0);
-	setFlag(flag_Sign, 0);
-	setFlag(flag_Carry, 0);
-	setFlag(flag_Zero, 1);
+	f->w = w;
+	f->r = FLAGS_EXPLICIT;
+}
+
+// Set zero and sign flags based on val, clear overflow and carry 
+static INLINE void setFlags_0z0s(struct f8_flags *f, uint8_t val) // O Z C S
+{
+	setResult(f, val, 0, val);
 }
 
 // Increment Indirect Scratchpad Address Register
 // affects just lower three bits, which roll-over 
-void incISAR(void)
+static INLINE uint8_t incISAR(uint8_t isar)
 {
-	F8_ISAR = (F8_ISAR&0x38) | ((F8_ISAR+1)&0x7);
+	return (isar&0x38) | ((isar+1)&0x7);
 }
 
 // Decrement Indirect Scratchpad Address Register
 // affects just lower three bits, which roll-over
-void decISAR(void)
+static INLINE uint8_t decISAR(uint8_t isar)
 {
-	F8_ISAR = (F8_ISAR&0x38) | ((F8_ISAR-1)&0x7);
+	return (isar&0x38) | ((isar-1)&0x7);
 }
 
-// Read Scratchpad Byte
-uint8_t Read8(uint8_t reg)
-{
-	return F8_R[reg & 0x3F];
-}
 // Read 16-bit int from Scratchpad
-uint16_t Read16(uint8_t reg)
+static INLINE uint16_t Read16(const uint8_t *R, uint8_t reg)
 {
-	return (F8_R[reg&0x3F]<<8) | F8_R[(reg+1)&0x3F];
+	return (R[reg&0x3F]<<8) | R[(reg+1)&0x3F];
 }
 // Write 16-bit int to Scratchpad
-void Store16(uint8_t reg, uint16_t val)
+static INLINE void Store16(uint8_t *R, uint8_t reg, uint16_t val)
 {
-	F8_R[reg&0x3F] = val>>8;
-	F8_R[(reg+1)&0x3F] = val;
+	R[reg&0x3F] = val>>8;
+	R[(reg+1)&0x3F] = val;
 }
 
 // Add two 8-bit signed ints
-uint8_t Add8(uint8_t a, uint8_t b)
+static INLINE uint8_t Add8(struct f8_flags *f, uint8_t a, uint8_t b)
 {
-	uint8_t signa = a & 0x80;
-	uint8_t signb = b & 0x80;
 	uint16_t result = (uint16_t) a + (uint16_t) b;
-	uint8_t signr = result & 0x80;
 
-	setFlag(flag_Sign, (result & 0x80)>0);
-	setFlag(flag_Zero, ((result & 0xFF)==0));
-	setFlag(flag_Overflow, (signa==signb && signa!=signr)); 
-	setFlag(flag_Carry, (result & 0x100)>0);
+	setResult(f, a, b, result);
 	return result;
 }
 
 // Add two 8-bit BCD numbers
-uint8_t AddBCD(uint8_t a, uint8_t b)
+static INLINE uint8_t AddBCD(struct f8_flags *f, uint8_t a, uint8_t b)
 {
 	// Method from 6-3 of the Fairchild F8 Guide to Programming
 	// assume a = (a + 0x66) & 0xFF
@@ -151,7 +140,7 @@ uint8_t AddBCD(uint8_t a, uint8_t b)
 	int ci = ((a&0xF)+(b&0xF))>0xF; // carry intermediate
 	int cu = sum>=0x100; // carry upper
 
-	Add8(a, b);
+	Add8(f, a, b);
 
 	if(ci==0) { sum = (sum&0xF0) | ((sum+0xA)&0xF); }
 	if(cu==0) { sum = (sum+0xA0); }
@@ -160,662 +149,698 @@ uint8_t AddBCD(uint8_t a, uint8_t b)
 }
 
 // Subtract two 8-bit signed ints
-uint8_t Sub8(uint8_t a, uint8_t b)
+static INLINE uint8_t Sub8(struct f8_flags *f, uint8_t a, uint8_t b)
 {
 	b = ((b ^ 0xFF) + 1);
-	return Add8(a, b); 
+	return Add8(f, a, b); 
 }
 
 // Bitwise And, sets flags
-uint8_t And8(uint8_t a, uint8_t b)
+static INLINE uint8_t And8(struct f8_flags *f, uint8_t a, uint8_t b)
 {
 	a = a & b;
-	setFlags_0z0s(a);
+	setFlags_0z0s(f, a);
 	return a;
 }
 // Bitwise Or, sets flags
-uint8_t Or8(uint8_t a, uint8_t b)
+static INLINE uint8_t Or8(struct f8_flags *f, uint8_t a, uint8_t b)
 {
 	a = a | b;
-	setFlags_0z0s(a);
+	setFlags_0z0s(f, a);
 	return a;
 }
 // Bitwise Xor, sets flags
-uint8_t Xor8(uint8_t a, uint8_t b)
+static INLINE uint8_t Xor8(struct f8_flags *f, uint8_t a, uint8_t b)
 {
 	a = (a ^ b);
-	setFlags_0z0s(a);
+	setFlags_0z0s(f, a);
 	return a;
 }
 // Logical Shift Right, sets flags
-uint8_t ShiftRight(uint8_t val, int dist)
+static INLINE uint8_t ShiftRight(struct f8_flags *f, uint8_t val, int dist)
 {
 	val = (val >> dist);
-	setFlags_0z0s(val);
+	setFlags_0z0s(f, val);
 	return val;
 }
 // Logical Shift Left, sets flags
-uint8_t ShiftLeft(uint8_t val, int dist)
+static INLINE uint8_t ShiftLeft(struct f8_flags *f, uint8_t val, int dist)
 {
 	val = (val << dist);
-	setFlags_0z0s(val);
+	setFlags_0z0s(f, val);
 	return val;
 }
 // Computes relative branch offset
-int calcBranch(uint8_t n)
+static INLINE int calcBranch(uint8_t n)
 {
 	if((n&0x80)==0) { return(n-1); } // forward
 	return -(((n-1)^0xFF)+1); // backward
 	
 }
 
+/* *****************************
+   *
+   *  Idle loop detection
+   *
+   ***************************** */
+
+// Loops are spotted after their first instruction has run, with the
+// branch back to it at pc. Skipping an iteration costs 'cost' ticks
+// (branch taken + body). Only as many iterations are skipped as would
+// have started every instruction before 'limit', so the run stops at
+// the same point as when stepping.
+static INLINE int loopIterations(int ticks, int limit, int cost)
+{
+	int left = limit - ticks - 7;
+	return left > 0 ? (left + cost - 1) / cost : 0;
+}
+
+// Is the instruction at pc a taken branch to the 'length' byte
+// instruction just before it?
+static INLINE int branchesBack(struct channelf *ctx, uint16_t pc, int length, struct f8_flags *f, uint8_t isar)
+{
+	uint8_t opcode = MEMORY_read8(ctx, pc);
+	uint8_t w;
+
+	if(MEMORY_read8(ctx, pc+1)!=(uint8_t)(-1-length))
+	{
+		return 0;
+	}
+	if(opcode==0x90) { return 1; } // BR
+	if(opcode==0x8F) { return (isar&0x7)!=7; } // BR7
+	w = getW(f);
+	if(opcode>=0x80 && opcode<=0x87) { return (w & (opcode&0x7))!=0; } // BT
+	if(opcode>=0x91 && opcode<=0x9F) { return (w & (opcode&0xF))==0; } // BF
+	return 0;
+}
+
 /* *****************************
    *
    *  Opcode functions
    *
    ***************************** */
 
-int LR_A_Ku(uint8_t v) // 00 LR A, Ku : A <- R12
+int LR_A_Ku(struct channelf *ctx, uint8_t v) // 00 LR A, Ku : A <- R12
 {
-	F8_A = F8_R[12];
+	ctx->F8_A = ctx->F8_R[12];
 	return 2;
 }
 
-int LR_A_Kl(uint8_t v) // 01 LR A, Kl : A <- R13
+int LR_A_Kl(struct channelf *ctx, uint8_t v) // 01 LR A, Kl : A <- R13
 {
-	F8_A = F8_R[13];
+	ctx->F8_A = ctx->F8_R[13];
 	return 2;
 }
 
-int LR_A_Qu(uint8_t v) // 02 LR A, Qu : A <- R14
+int LR_A_Qu(struct channelf *ctx, uint8_t v) // 02 LR A, Qu : A <- R14
 {
-	F8_A = F8_R[14];
+	ctx->F8_A = ctx->F8_R[14];
 	return 2;
 }
 
-int LR_A_Ql(uint8_t v) // 03 LR A, Ql : A <- R15 
+int LR_A_Ql(struct channelf *ctx, uint8_t v) // 03 LR A, Ql : A <- R15 
 {
-	F8_A = F8_R[15];
+	ctx->F8_A = ctx->F8_R[15];
 	return 2;
 } 
 
-int LR_Ku_A(uint8_t v) // 04 LR Ku, A : R12 <- A 
+int LR_Ku_A(struct channelf *ctx, uint8_t v) // 04 LR Ku, A : R12 <- A 
 {
-	F8_R[12] = F8_A;
+	ctx->F8_R[12] = ctx->F8_A;
 	return 2;
 }
 
-int LR_Kl_A(uint8_t v) // 05 LR Kl, A : R13 <- A 
+int LR_Kl_A(struct channelf *ctx, uint8_t v) // 05 LR Kl, A : R13 <- A 
 {
-	F8_R[13] = F8_A;
+	ctx->F8_R[13] = ctx->F8_A;
 	return 2;
 } 
 
-int LR_Qu_A(uint8_t v) // 06 LR Qu, A : R14 <- A
+int LR_Qu_A(struct channelf *ctx, uint8_t v) // 06 LR Qu, A : R14 <- A
 {
-	F8_R[14] = F8_A;
+	ctx->F8_R[14] = ctx->F8_A;
 	return 2;
 } 
 
-int LR_Ql_A(uint8_t v) // 07 LR Ql, A : R15 <- A 
+int LR_Ql_A(struct channelf *ctx, uint8_t v) // 07 LR Ql, A : R15 <- A 
 {
-	F8_R[15] = F8_A;
+	ctx->F8_R[15] = ctx->F8_A;
 	return 2;
 } 
 
-int LR_K_P(uint8_t v) // 08 LR K, P  : R12 <- PC1U, R13 <- PC1L
+int LR_K_P(struct channelf *ctx, uint8_t v) // 08 LR K, P  : R12 <- PC1U, R13 <- PC1L
 {
-	Store16(12, F8_PC1);
+	Store16(ctx->F8_R, 12, ctx->F8_PC1);
 	return 8;
 }
 
-int LR_P_K(uint8_t v)  // 09 LR P, K  : PC1U <- R12, PC1L <- R13
+int LR_P_K(struct channelf *ctx, uint8_t v)  // 09 LR P, K  : PC1U <- R12, PC1L <- R13
 {
-	F8_PC1 = Read16(12);
+	ctx->F8_PC1 = Read16(ctx->F8_R, 12);
 	return 8;
 } 
 
-int LR_A_IS(uint8_t v) // 0A LR A, IS : A <- ISAR 
+int LR_A_IS(struct channelf *ctx, uint8_t v) // 0A LR A, IS : A <- ISAR 
 {
-	F8_A = F8_ISAR;
+	ctx->F8_A = ctx->F8_ISAR;
 	return 2;
 }
 
-int LR_IS_A(uint8_t v) // 0B LR IS, A : ISAR <- A
+int LR_IS_A(struct channelf *ctx, uint8_t v) // 0B LR IS, A : ISAR <- A
 {
-	F8_ISAR = F8_A & 0x3F;
+	ctx->F8_ISAR = ctx->F8_A & 0x3F;
 	return 2;
 }
 
-int PK(uint8_t v) // 0C PK PC1 <- PC0, PC0U <- R12, PC0L <- R13
+int PK(struct channelf *ctx, uint8_t v) // 0C PK PC1 <- PC0, PC0U <- R12, PC0L <- R13
 {
-	F8_PC1 = F8_PC0;
-	F8_PC0 = Read16(12);
+	ctx->F8_PC1 = ctx->F8_PC0;
+	ctx->F8_PC0 = Read16(ctx->F8_R, 12);
 	return 5;
 }
 
-int LR_P0_Q(uint8_t v) // 0D LR P0, Q : PC0L <- R15, PC0U <- R14
+int LR_P0_Q(struct channelf *ctx, uint8_t v) // 0D LR P0, Q : PC0L <- R15, PC0U <- R14
 {
-	F8_PC0 = Read16(14);
+	ctx->F8_PC0 = Read16(ctx->F8_R, 14);
 	return 8;
 }
 
-int LR_Q_DC(uint8_t v) // 0E LR Q, DC : R14 <- DC0U, R15 <- DC0L 
+int LR_Q_DC(struct channelf *ctx, uint8_t v) // 0E LR Q, DC : R14 <- DC0U, R15 <- DC0L 
 {
-	Store16(14, F8_DC0);
+	Store16(ctx->F8_R, 14, ctx->F8_DC0);
 	return 8;
 }
 
-int LR_DC_Q(uint8_t v) // 0F LR DC, Q : DC0U <- R14, DC0L <- R15
+int LR_DC_Q(struct channelf *ctx, uint8_t v) // 0F LR DC, Q : DC0U <- R14, DC0L <- R15
 {
-	F8_DC0 = Read16(14);
+	ctx->F8_DC0 = Read16(ctx->F8_R, 14);
 	return 8;
 }
 
-int LR_DC_H(uint8_t v) // 10 LR DC, H : DC0U <- R10, DC0L <- R11 
+int LR_DC_H(struct channelf *ctx, uint8_t v) // 10 LR DC, H : DC0U <- R10, DC0L <- R11 
 {
-	F8_DC0 = Read16(10);
+	ctx->F8_DC0 = Read16(ctx->F8_R, 10);
 	return 8; 
 }
 
-int LR_H_DC(uint8_t v) // 11 LR H, DC : R10 <- DC0U, R11 <- DC0L
+int LR_H_DC(struct channelf *ctx, uint8_t v) // 11 LR H, DC : R10 <- DC0U, R11 <- DC0L
 {
-	Store16(10, F8_DC0);
+	Store16(ctx->F8_R, 10, ctx->F8_DC0);
 	return 8;
 } 
 
-int SR_1(uint8_t v) // 12 SR 1 : A >> 1
+int SR_1(struct channelf *ctx, uint8_t v) // 12 SR 1 : A >> 1
 {
-	F8_A = ShiftRight(F8_A, 1);
+	ctx->F8_A = ShiftRight(&ctx->F8_Flags, ctx->F8_A, 1);
 	return 2;
 } 
 
-int SL_1(uint8_t v) // 13 SL 1 : A << 1
+int SL_1(struct channelf *ctx, uint8_t v) // 13 SL 1 : A << 1
 {
-	F8_A = ShiftLeft(F8_A, 1);
+	ctx->F8_A = ShiftLeft(&ctx->F8_Flags, ctx->F8_A, 1);
 	return 2;
 } 
 
-int SR_4(uint8_t v) // 14 SR 4 : A >> 4
+int SR_4(struct channelf *ctx, uint8_t v) // 14 SR 4 : A >> 4
 {
-	F8_A = ShiftRight(F8_A, 4);
+	ctx->F8_A = ShiftRight(&ctx->F8_Flags, ctx->F8_A, 4);
 	return 2;
 }
 
-int SL_4(uint8_t v) // 15 SL 4 : A << 4
+int SL_4(struct channelf *ctx, uint8_t v) // 15 SL 4 : A << 4
 { 
-	F8_A = ShiftLeft(F8_A, 4);
+	ctx->F8_A = ShiftLeft(&ctx->F8_Flags, ctx->F8_A, 4);
 	return 2;
 } 
 
-int LM(uint8_t v) // 16 LM A <- (DC0), DC0 <- DC0 + 1
+int LM(struct channelf *ctx, uint8_t v) // 16 LM A <- (DC0), DC0 <- DC0 + 1
 {
-	F8_A = MEMORY_read8(F8_DC0++);
+	ctx->F8_A = MEMORY_read8(ctx, ctx->F8_DC0++);
 	return 5;
 } 
 
-int ST(uint8_t v) // 17 ST (DC0) <- A, DC0 <- DC0 + 1 
+int ST(struct channelf *ctx, uint8_t v) // 17 ST (DC0) <- A, DC0 <- DC0 + 1 
 {
-	MEMORY_write8(F8_DC0++, F8_A);
+	MEMORY_write8(ctx, ctx->F8_DC0++, ctx->F8_A);
 	return 5;
 }        
 
-int COM(uint8_t v) // 18 COM A : A <- A XOR 0xFF                
+int COM(struct channelf *ctx, uint8_t v) // 18 COM A : A <- A XOR 0xFF                
 {
-	F8_A = F8_A ^ 0xFF;
-	setFlags_0z0s(F8_A);
+	ctx->F8_A = ctx->F8_A ^ 0xFF;
+	setFlags_0z0s(&ctx->F8_Flags, ctx->F8_A);
 	return 2;
 }
 
-int LNK(uint8_t v) // 19 LNK : A <- A + C                       
+int LNK(struct channelf *ctx, uint8_t v) // 19 LNK : A <- A + C                       
 {
-	F8_A = Add8(F8_A, (F8_W>>flag_Carry)&1);
+	ctx->F8_A = Add8(&ctx->F8_Flags, ctx->F8_A, (getW(&ctx->F8_Flags)>>flag_Carry)&1);
 	return 2;
 }
 
-int DI(uint8_t v) // 1A DI : Disable Interupts                 
+int DI(struct channelf *ctx, uint8_t v) // 1A DI : Disable Interupts                 
 {
-	setFlag(flag_Interupt, 0);
+	ctx->F8_Flags.w &= ~(1<<flag_Interupt);
 	return 2; 
 }
 
-int EI(uint8_t v) // 1B EI : Enable Interupts                  
+int EI(struct channelf *ctx, uint8_t v) // 1B EI : Enable Interupts                  
 {
-	setFlag(flag_Interupt, 1);
+	ctx->F8_Flags.w |= 1<<flag_Interupt;
 	return 2;
 }
 
-int POP(uint8_t v) // 1C POP : PC0 <- PC1                       
+int POP(struct channelf *ctx, uint8_t v) // 1C POP : PC0 <- PC1                       
 {
-	F8_PC0 = F8_PC1;
+	ctx->F8_PC0 = ctx->F8_PC1;
 	return 4;
 }
 
-int LR_W_J(uint8_t v) // 1D LR W, J : W <- R9                      
+int LR_W_J(struct channelf *ctx, uint8_t v) // 1D LR W, J : W <- R9                      
 { 
-	F8_W = F8_R[9];
+	setW(&ctx->F8_Flags, ctx->F8_R[9]);
 	return 2;
 }
 
-int LR_J_W(uint8_t v) // 1E LR J, W : R9 <- W                      
+int LR_J_W(struct channelf *ctx, uint8_t v) // 1E LR J, W : R9 <- W                      
 {
-	F8_R[9] = F8_W;
+	ctx->F8_R[9] = getW(&ctx->F8_Flags);
 	return 4;
 }
 
-int INC(uint8_t v) // 1F INC : A <- A + 1                       
+int INC(struct channelf *ctx, uint8_t v) // 1F INC : A <- A + 1                       
 {
-	F8_A = Add8(F8_A, 1);
+	ctx->F8_A = Add8(&ctx->F8_Flags, ctx->F8_A, 1);
 	return 2;
 } 
 
-int LI_n(uint8_t v) // 20 LI n : A <- n                          
+int LI_n(struct channelf *ctx, uint8_t v) // 20 LI n : A <- n                          
 {
-	F8_A = readOperand8();
+	ctx->F8_A = readOperand8(ctx);
 	return 5; 
 } 
 
-int NI_n(uint8_t v) // 21 NI n : A <- A AND n                    
+int NI_n(struct channelf *ctx, uint8_t v) // 21 NI n : A <- A AND n                    
 {
-	F8_A = And8(F8_A, readOperand8());
+	ctx->F8_A = And8(&ctx->F8_Flags, ctx->F8_A, readOperand8(ctx));
 	return 5;
 } 
 
-int OI_n(uint8_t v) // 22 OI n : A <- A OR n                     
+int OI_n(struct channelf *ctx, uint8_t v) // 22 OI n : A <- A OR n                     
 {
-	F8_A = Or8(F8_A, readOperand8());
+	ctx->F8_A = Or8(&ctx->F8_Flags, ctx->F8_A, readOperand8(ctx));
 	return 5;
 } 
 
-int XI_n(uint8_t v)   // 23 XI n : A <- A XOR n                    
+int XI_n(struct channelf *ctx, uint8_t v)   // 23 XI n : A <- A XOR n                    
 {
-	F8_A = Xor8(F8_A, readOperand8());
+	ctx->F8_A = Xor8(&ctx->F8_Flags, ctx->F8_A, readOperand8(ctx));
 	return 5;
 } 
 
-int AI_n(uint8_t v)   // 24 AI n : A <- A + n                      
+int AI_n(struct channelf *ctx, uint8_t v)   // 24 AI n : A <- A + n                      
 {
-	F8_A = Add8(F8_A, readOperand8());
+	ctx->F8_A = Add8(&ctx->F8_Flags, ctx->F8_A, readOperand8(ctx));
 	return 5;
 }
 
-int CI_n(uint8_t v)   // 25 CI n : n+!(A)+1 (n-A), Only set status 
+int CI_n(struct channelf *ctx, uint8_t v)   // 25 CI n : n+!(A)+1 (n-A), Only set status 
 {
-	Sub8(readOperand8(), F8_A);
+	Sub8(&ctx->F8_Flags, readOperand8(ctx), ctx->F8_A);
 	return 5;
 } 
 
-int IN_n(uint8_t v) // 26 IN n : Data Bus <- Port n, A <- Port n
+int IN_n(struct channelf *ctx, uint8_t v) // 26 IN n : Data Bus <- Port n, A <- Port n
 { 
-	F8_A = PORTS_read(readOperand8());
-	setFlags_0z0s(F8_A);
+	ctx->F8_A = PORTS_read(ctx, readOperand8(ctx));
+	setFlags_0z0s(&ctx->F8_Flags, ctx->F8_A);
 	return 8;
 } 
 
-int OUT_n(uint8_t v) // 27 OUT n : Data Bus <- Port n, Port n <- A
+int OUT_n(struct channelf *ctx, uint8_t v) // 27 OUT n : Data Bus <- Port n, Port n <- A
 {
-	PORTS_notify(readOperand8(), F8_A);
+	PORTS_notify(ctx, readOperand8(ctx), ctx->F8_A);
 	return 8;
 } 
 
-int PI_mn(uint8_t v) // 28 PI mn : A <- m, PC1 <- PC0+1, PC0L <- n, PC0U <- A 
+int PI_mn(struct channelf *ctx, uint8_t v) // 28 PI mn : A <- m, PC1 <- PC0+1, PC0L <- n, PC0U <- A 
 { 
-	F8_A = readOperand8();   // A <- m
-	F8_PC1 = F8_PC0+1;          // PC1 <- PC0+1
-	F8_PC0 = readOperand8(); // PC0L <- n
-	F8_PC0 = F8_PC0 | (F8_A<<8);   // PC0U <- A
+	ctx->F8_A = readOperand8(ctx);   // A <- m
+	ctx->F8_PC1 = ctx->F8_PC0+1;          // PC1 <- PC0+1
+	ctx->F8_PC0 = readOperand8(ctx); // PC0L <- n
+	ctx->F8_PC0 = ctx->F8_PC0 | (ctx->F8_A<<8);   // PC0U <- A
 	return 13;
 } 
 
-int JMP_mn(uint8_t v) // 29 JMP mn : A <- m, PC0L <- n, PC0U <- A 
+int JMP_mn(struct channelf *ctx, uint8_t v) // 29 JMP mn : A <- m, PC0L <- n, PC0U <- A 
 {
-	F8_A = readOperand8(); // A <- m
-	F8_PC0=readOperand8(); // PC0L <- n
-	F8_PC0 |= (F8_A<<8);      // PC0U <- A
+	ctx->F8_A = readOperand8(ctx); // A <- m
+	ctx->F8_PC0=readOperand8(ctx); // PC0L <- n
+	ctx->F8_PC0 |= (ctx->F8_A<<8);      // PC0U <- A
 	return 11;
 }
 
-int DCI_mn(uint8_t v) // 2A DCI mn : DC0U <- m, PC0++, DC0L <- n, PC0++ 
+int DCI_mn(struct channelf *ctx, uint8_t v) // 2A DCI mn : DC0U <- m, PC0++, DC0L <- n, PC0++ 
 {
-	F8_DC0=readOperand16();
+	ctx->F8_DC0=readOperand16(ctx);
 	return 12;
 } 
 
-int NOP(uint8_t v) // 2B NOP
+int NOP(struct channelf *ctx, uint8_t v) // 2B NOP
 {
 	return 2;
 } 
 
-int XDC(uint8_t v) // 2C DC0,DC1 <- DC1,DC0 
+int XDC(struct channelf *ctx, uint8_t v) // 2C DC0,DC1 <- DC1,DC0 
 {
-	F8_DC0^=F8_DC1;
-	F8_DC1^=F8_DC0;
-	F8_DC0^=F8_DC1;
+	ctx->F8_DC0^=ctx->F8_DC1;
+	ctx->F8_DC1^=ctx->F8_DC0;
+	ctx->F8_DC0^=ctx->F8_DC1;
 	return 4;
 }
 
-int DS_r(uint8_t v) // 3x DS r <- (r)+0xFF, [decrease scratchpad byte]
+int DS_r(struct channelf *ctx, uint8_t v) // 3x DS r <- (r)+0xFF, [decrease scratchpad byte]
 {
-	F8_R[v&0xF] = Sub8(F8_R[v&0xF], 1);
+	ctx->F8_R[v&0xF] = Sub8(&ctx->F8_Flags, ctx->F8_R[v&0xF], 1);
 	return 3;
 } 
-int DS_r_S(uint8_t v) // DS r Indirect
+int DS_r_S(struct channelf *ctx, uint8_t v) // DS r Indirect
 {
-	F8_R[F8_ISAR] = Sub8(F8_R[F8_ISAR], 1);
+	ctx->F8_R[ctx->F8_ISAR] = Sub8(&ctx->F8_Flags, ctx->F8_R[ctx->F8_ISAR], 1);
 	return 3;
 }
-int DS_r_I(uint8_t v) // DS r Increment
+int DS_r_I(struct channelf *ctx, uint8_t v) // DS r Increment
 {
-	F8_R[F8_ISAR] = Sub8(F8_R[F8_ISAR], 1);
-	incISAR();
+	ctx->F8_R[ctx->F8_ISAR] = Sub8(&ctx->F8_Flags, ctx->F8_R[ctx->F8_ISAR], 1);
+	ctx->F8_ISAR = incISAR(ctx->F8_ISAR);
 	return 3;
 }
-int DS_r_D(uint8_t v) // DS r Decrement
+int DS_r_D(struct channelf *ctx, uint8_t v) // DS r Decrement
 {
-	F8_R[F8_ISAR] = Sub8(F8_R[F8_ISAR], 1);
-	decISAR();
+	ctx->F8_R[ctx->F8_ISAR] = Sub8(&ctx->F8_Flags, ctx->F8_R[ctx->F8_ISAR], 1);
+	ctx->F8_ISAR = decISAR(ctx->F8_ISAR);
 	return 3;
 }
 
-int LR_A_r(uint8_t v) // 4x LR A, r : A <- r 
+int LR_A_r(struct channelf *ctx, uint8_t v) // 4x LR A, r : A <- r 
 {
-	F8_A = F8_R[v&0xF];
+	ctx->F8_A = ctx->F8_R[v&0xF];
 	return 2;
 } 
-int LR_A_r_S(uint8_t v) // LR A, r Indirect
+int LR_A_r_S(struct channelf *ctx, uint8_t v) // LR A, r Indirect
 {
-	F8_A = F8_R[F8_ISAR];
+	ctx->F8_A = ctx->F8_R[ctx->F8_ISAR];
 	return 2;
 }
-int LR_A_r_I(uint8_t v) // LR A, r Increment
+int LR_A_r_I(struct channelf *ctx, uint8_t v) // LR A, r Increment
 {
-	F8_A = F8_R[F8_ISAR];
-	incISAR();
+	ctx->F8_A = ctx->F8_R[ctx->F8_ISAR];
+	ctx->F8_ISAR = incISAR(ctx->F8_ISAR);
 	return 2;
 }
-int LR_A_r_D(uint8_t v) // LR A, r Decrement
+int LR_A_r_D(struct channelf *ctx, uint8_t v) // LR A, r Decrement
 {
-	F8_A = F8_R[F8_ISAR];
-	decISAR();
+	ctx->F8_A = ctx->F8_R[ctx->F8_ISAR];
+	ctx->F8_ISAR = decISAR(ctx->F8_ISAR);
 	return 2;
 }
 	
-int LR_r_A(uint8_t v)   // 5x LR r, A : r <- A
+int LR_r_A(struct channelf *ctx, uint8_t v)   // 5x LR r, A : r <- A
 {
-	F8_R[v&0xF] = F8_A;
+	ctx->F8_R[v&0xF] = ctx->F8_A;
 	return 2;
 } 
-int LR_r_A_S(uint8_t v) // LR r, A Indirect
+int LR_r_A_S(struct channelf *ctx, uint8_t v) // LR r, A Indirect
 {
-	F8_R[F8_ISAR] = F8_A;
+	ctx->F8_R[ctx->F8_ISAR] = ctx->F8_A;
 	return 2;
 }
-int LR_r_A_I(uint8_t v) // LR r, A Increment
+int LR_r_A_I(struct channelf *ctx, uint8_t v) // LR r, A Increment
 {
-	F8_R[F8_ISAR] = F8_A;
-	incISAR();
+	ctx->F8_R[ctx->F8_ISAR] = ctx->F8_A;
+	ctx->F8_ISAR = incISAR(ctx->F8_ISAR);
 	return 2;
 }
-int LR_r_A_D(uint8_t v) // LR r, A Decrement
+int LR_r_A_D(struct channelf *ctx, uint8_t v) // LR r, A Decrement
 {
-	F8_R[F8_ISAR] = F8_A;
-	decISAR();
+	ctx->F8_R[ctx->F8_ISAR] = ctx->F8_A;
+	ctx->F8_ISAR = decISAR(ctx->F8_ISAR);
 	return 2;
 }
 
-int LISU_i(uint8_t v) // 6x LISU i : ISARU <- i
+int LISU_i(struct channelf *ctx, uint8_t v) // 6x LISU i : ISARU <- i
 {
-	F8_ISAR = (F8_ISAR & 0x07) | ((v&0x7)<<3);
+	ctx->F8_ISAR = (ctx->F8_ISAR & 0x07) | ((v&0x7)<<3);
 	return 2;
 } 
 
-int LISL_i(uint8_t v) // 6x LISL i : ISARL <- i
+int LISL_i(struct channelf *ctx, uint8_t v) // 6x LISL i : ISARL <- i
 {
-	F8_ISAR = (F8_ISAR & 0x38) | (v&0x7);
+	ctx->F8_ISAR = (ctx->F8_ISAR & 0x38) | (v&0x7);
 	return 2;
 }
 
-int LIS_i(uint8_t v) // 7x LIS i : A <- i 
+int LIS_i(struct channelf *ctx, uint8_t v) // 7x LIS i : A <- i 
 { 
-	F8_A = v&0xF;
+	ctx->F8_A = v&0xF;
 	return 2;
 } 
 
-int BT_t_n(uint8_t v) // 8x BT t, n : 1000 0ttt nnnn nnnn : 
+int BT_t_n(struct channelf *ctx, uint8_t v) // 8x BT t, n : 1000 0ttt nnnn nnnn : 
 {
 	// AND bitmask t with W, if result is not 0: PC0<-PC0+n+1
-	int t = ((F8_W) & (v&0x7))!=0;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = (getW(&ctx->F8_Flags) & (v&0x7))!=0;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int BP_n(uint8_t v)   // 81 BP n : branch if POSITIVE: PC0<-PC0+n+1 
+int BP_n(struct channelf *ctx, uint8_t v)   // 81 BP n : branch if POSITIVE: PC0<-PC0+n+1 
 {
-	int t = ((F8_W>>flag_Sign)&1)==1;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = ((getW(&ctx->F8_Flags)>>flag_Sign)&1)==1;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int BC_n(uint8_t v)   // 82 BC n : branch if CARRY: PC0<-PC0+n+1
+int BC_n(struct channelf *ctx, uint8_t v)   // 82 BC n : branch if CARRY: PC0<-PC0+n+1
 {
-	int t = ((F8_W>>flag_Carry)&1)==1;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = ((getW(&ctx->F8_Flags)>>flag_Carry)&1)==1;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int BZ_n(uint8_t v)   // 84 BZ n : branch if ZERO: PC0<-PC0+n+1
+int BZ_n(struct channelf *ctx, uint8_t v)   // 84 BZ n : branch if ZERO: PC0<-PC0+n+1
 {
-	int t = ((F8_W>>flag_Zero)&1)==1;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = ((getW(&ctx->F8_Flags)>>flag_Zero)&1)==1;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int AM(uint8_t v)  // 88 AM  : A <- A+(DC0), DC0++
+int AM(struct channelf *ctx, uint8_t v)  // 88 AM  : A <- A+(DC0), DC0++
 {
-	F8_A = Add8(F8_A, MEMORY_read8(F8_DC0++));
+	ctx->F8_A = Add8(&ctx->F8_Flags, ctx->F8_A, MEMORY_read8(ctx, ctx->F8_DC0++));
 	return 5;
 } 
 
-int AMD(uint8_t v) // 89 AMD : A <- A+(DC0) decimal adjusted, DC0++
+int AMD(struct channelf *ctx, uint8_t v) // 89 AMD : A <- A+(DC0) decimal adjusted, DC0++
 {
-	F8_A = AddBCD(F8_A, MEMORY_read8(F8_DC0++));
+	ctx->F8_A = AddBCD(&ctx->F8_Flags, ctx->F8_A, MEMORY_read8(ctx, ctx->F8_DC0++));
 	return 5;
 } 
 
-int NM(uint8_t v) // 8A NM  : A <- A AND (DC0), DC0+1
+int NM(struct channelf *ctx, uint8_t v) // 8A NM  : A <- A AND (DC0), DC0+1
 {
-	F8_A = And8(F8_A, MEMORY_read8(F8_DC0++));
+	ctx->F8_A = And8(&ctx->F8_Flags, ctx->F8_A, MEMORY_read8(ctx, ctx->F8_DC0++));
 	return 5;
 }
 
-int OM(uint8_t v) // 8B OM  : A <-  A OR (DC0), DC0+1
+int OM(struct channelf *ctx, uint8_t v) // 8B OM  : A <-  A OR (DC0), DC0+1
 {
-	F8_A = Or8(F8_A, MEMORY_read8(F8_DC0++));
+	ctx->F8_A = Or8(&ctx->F8_Flags, ctx->F8_A, MEMORY_read8(ctx, ctx->F8_DC0++));
 	return 5;
 } 
 
-int XM(uint8_t v) // 8C XM  : A <-  A OR (DC0), DC0+1
+int XM(struct channelf *ctx, uint8_t v) // 8C XM  : A <-  A OR (DC0), DC0+1
 {
-	F8_A = Xor8(F8_A, MEMORY_read8(F8_DC0++));
+	ctx->F8_A = Xor8(&ctx->F8_Flags, ctx->F8_A, MEMORY_read8(ctx, ctx->F8_DC0++));
 	return 5;
 }
 
-int CM(uint8_t v) // 8D CM  : (DC0) - A, only set status, DC0+1
+int CM(struct channelf *ctx, uint8_t v) // 8D CM  : (DC0) - A, only set status, DC0+1
 {
-	Sub8(MEMORY_read8(F8_DC0++), F8_A);
+	Sub8(&ctx->F8_Flags, MEMORY_read8(ctx, ctx->F8_DC0++), ctx->F8_A);
 	return 5;
 } 
 
-int ADC(uint8_t v) // 8E ADC : DC0 <- DC0 + A
+int ADC(struct channelf *ctx, uint8_t v) // 8E ADC : DC0 <- DC0 + A
 { 
-	F8_DC0 += F8_A+(0xFF00*(F8_A>0x7F)); // A is signed
+	ctx->F8_DC0 += ctx->F8_A+(0xFF00*(ctx->F8_A>0x7F)); // A is signed
 	return 5;
 } 
 
-int BR7_n(uint8_t v)   // 8F BR7 n : if ISARL != 7: PC0<-PC0+n+1 
+int BR7_n(struct channelf *ctx, uint8_t v)   // 8F BR7 n : if ISARL != 7: PC0<-PC0+n+1 
 {
-	int t = (F8_ISAR&0x7)!=7;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = (ctx->F8_ISAR&0x7)!=7;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int BR_n(uint8_t v) // 90 BR n : PC0 <- PC0+n+1
+int BR_n(struct channelf *ctx, uint8_t v) // 90 BR n : PC0 <- PC0+n+1
 { 
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n);
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n);
 	return 7;
 }
 
-int BN_n(uint8_t v)   // 91 BN n : branch if NEGATIVE PC0<-PC0+n+1
+int BN_n(struct channelf *ctx, uint8_t v)   // 91 BN n : branch if NEGATIVE PC0<-PC0+n+1
 {
-	int t = ((F8_W>>flag_Sign)&1)==0;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = ((getW(&ctx->F8_Flags)>>flag_Sign)&1)==0;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int BNC_n(uint8_t v) // 92 BNC n : branch if NO CARRY: PC0 <- PC0+n+1 
+int BNC_n(struct channelf *ctx, uint8_t v) // 92 BNC n : branch if NO CARRY: PC0 <- PC0+n+1 
 {
-	int t = ((F8_W>>flag_Carry)&1)==0;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = ((getW(&ctx->F8_Flags)>>flag_Carry)&1)==0;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int BF_i_n(uint8_t v) // 9x BF i, n : 1001 iiii nnnn nnnn 
+int BF_i_n(struct channelf *ctx, uint8_t v) // 9x BF i, n : 1001 iiii nnnn nnnn 
 {
 	// AND bitmask i with W, if result is 0: PC0 <- PC0+n+1
-	int t = ((F8_W) & (v&0xF))==0;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = (getW(&ctx->F8_Flags) & (v&0xF))==0;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int BNZ_n(uint8_t v)  // 94 BNZ n : branch if NOT ZERO: PC0 <- PC0+n+1 
+int BNZ_n(struct channelf *ctx, uint8_t v)  // 94 BNZ n : branch if NOT ZERO: PC0 <- PC0+n+1 
 {
-	int t = ((F8_W>>flag_Zero)&1)==0;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = ((getW(&ctx->F8_Flags)>>flag_Zero)&1)==0;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int BNO_n(uint8_t v) // 98 BNO n : branch if NO OVERFLOW: PC0 <- PC0+n+1 
+int BNO_n(struct channelf *ctx, uint8_t v) // 98 BNO n : branch if NO OVERFLOW: PC0 <- PC0+n+1 
 {
-	int t = ((F8_W>>flag_Overflow)&1)==0;
-	uint8_t n = readOperand8();
-	F8_PC0 = F8_PC0+calcBranch(n)*(t);
+	int t = ((getW(&ctx->F8_Flags)>>flag_Overflow)&1)==0;
+	uint8_t n = readOperand8(ctx);
+	ctx->F8_PC0 = ctx->F8_PC0+calcBranch(n)*(t);
 	return 6 + (t); // 3 - no jump,  3.5 - jump
 }
 
-int INS_i(uint8_t v)  // Ax INS_i : 1010 iiii : A <- (Port i)
+int INS_i(struct channelf *ctx, uint8_t v)  // Ax INS_i : 1010 iiii : A <- (Port i)
 {
 	//  if i=2..15: Data Bus <- Port Address, A <- (Port i)
-	F8_A = PORTS_read(v&0xF);
-	setFlags_0z0s(F8_A);
+	ctx->F8_A = PORTS_read(ctx, v&0xF);
+	setFlags_0z0s(&ctx->F8_Flags, ctx->F8_A);
 	return 4 + 4*((v&0xF)>1); // 2 i=0..1, 4 i=2..15
 }
 
-int OUTS_i(uint8_t v) // Bx OUTS i : 1011 iiii : Port i <- A
+int OUTS_i(struct channelf *ctx, uint8_t v) // Bx OUTS i : 1011 iiii : Port i <- A
 {
 	// if i=2..15: Data Bus <- Port Address, Port i <- A
-	PORTS_notify(v&0xF, F8_A);
+	PORTS_notify(ctx, v&0xF, ctx->F8_A);
 	return 4 + 4*((v&0xF)>1); // 2 i=0..1, 4 i=2..15
 }
 
-int AS_r(uint8_t v) // Cx AS r : A <- A+(r) 
+int AS_r(struct channelf *ctx, uint8_t v) // Cx AS r : A <- A+(r) 
 {
-	F8_A = Add8(F8_A, F8_R[v&0xF]);
+	ctx->F8_A = Add8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[v&0xF]);
 	return 2;
 } 
-int AS_r_S(uint8_t v) // AS r Indirect
+int AS_r_S(struct channelf *ctx, uint8_t v) // AS r Indirect
 {
-	F8_A = Add8(F8_A, F8_R[F8_ISAR]);
+	ctx->F8_A = Add8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
 	return 2;
 }
-int AS_r_I(uint8_t v) // AS r Increment
+int AS_r_I(struct channelf *ctx, uint8_t v) // AS r Increment
 {
-	F8_A = Add8(F8_A, F8_R[F8_ISAR]);
-	incISAR();
+	ctx->F8_A = Add8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
+	ctx->F8_ISAR = incISAR(ctx->F8_ISAR);
 	return 2;
 }
-int AS_r_D(uint8_t v) // AS r Decrement
+int AS_r_D(struct channelf *ctx, uint8_t v) // AS r Decrement
 {
-	F8_A = Add8(F8_A, F8_R[F8_ISAR]);
-	decISAR();
+	ctx->F8_A = Add8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
+	ctx->F8_ISAR = decISAR(ctx->F8_ISAR);
 	return 2;
 }
 
-int ASD_r(uint8_t v)   // Dx ASD r  : A <- A+(r) [BCD]
+int ASD_r(struct channelf *ctx, uint8_t v)   // Dx ASD r  : A <- A+(r) [BCD]
 {
-	F8_A = AddBCD(F8_A, F8_R[v&0xF]);
+	ctx->F8_A = AddBCD(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[v&0xF]);
 	return 4;
 }
-int ASD_r_S(uint8_t v) // ASD r Indirect
+int ASD_r_S(struct channelf *ctx, uint8_t v) // ASD r Indirect
 {
-	F8_A = AddBCD(F8_A, F8_R[F8_ISAR]); 
+	ctx->F8_A = AddBCD(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]); 
 	return 4;
 }
-int ASD_r_I(uint8_t v) // ASD r Increment
+int ASD_r_I(struct channelf *ctx, uint8_t v) // ASD r Increment
 {
-	F8_A = AddBCD(F8_A, F8_R[F8_ISAR]);
-	incISAR();
+	ctx->F8_A = AddBCD(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
+	ctx->F8_ISAR = incISAR(ctx->F8_ISAR);
 	return 4;
 }
-int ASD_r_D(uint8_t v) // ASD r Decrement
+int ASD_r_D(struct channelf *ctx, uint8_t v) // ASD r Decrement
 {
-	F8_A = AddBCD(F8_A, F8_R[F8_ISAR]);
-	decISAR();
+	ctx->F8_A = AddBCD(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
+	ctx->F8_ISAR = decISAR(ctx->F8_ISAR);
 	return 4;
 }
 
-int XS_r(uint8_t v) // Ex XS r   : A <- A XOR (r) 
+int XS_r(struct channelf *ctx, uint8_t v) // Ex XS r   : A <- A XOR (r) 
 {
-	F8_A = Xor8(F8_A, F8_R[v&0xF]);
+	ctx->F8_A = Xor8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[v&0xF]);
 	return 2;
 } 
-int XS_r_S(uint8_t v) // XS r Indirect
+int XS_r_S(struct channelf *ctx, uint8_t v) // XS r Indirect
 {
-	F8_A = Xor8(F8_A, F8_R[F8_ISAR]);
+	ctx->F8_A = Xor8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
 	return 2;
 }
-int XS_r_I(uint8_t v) // XS r Increment
+int XS_r_I(struct channelf *ctx, uint8_t v) // XS r Increment
 {
-	F8_A = Xor8(F8_A, F8_R[F8_ISAR]);
-	incISAR();
+	ctx->F8_A = Xor8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
+	ctx->F8_ISAR = incISAR(ctx->F8_ISAR);
 	return 2;
 }
-int XS_r_D(uint8_t v) // XS r Decrement
+int XS_r_D(struct channelf *ctx, uint8_t v) // XS r Decrement
 {
-	F8_A = Xor8(F8_A, F8_R[F8_ISAR]);
-	decISAR();
+	ctx->F8_A = Xor8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
+	ctx->F8_ISAR = decISAR(ctx->F8_ISAR);
 	return 2;
 }
 
-int NS_r(uint8_t v)  // Fx NS r   : A <- A AND (r) 
+int NS_r(struct channelf *ctx, uint8_t v)  // Fx NS r   : A <- A AND (r) 
 {
-	F8_A = And8(F8_A, F8_R[v&0xF]);
+	ctx->F8_A = And8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[v&0xF]);
 	return 2;
 }
-int NS_r_S(uint8_t v) // NS r Indirect
+int NS_r_S(struct channelf *ctx, uint8_t v) // NS r Indirect
 {
-	F8_A = And8(F8_A, F8_R[F8_ISAR]);
+	ctx->F8_A = And8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
 	return 2;
 }
-int NS_r_I(uint8_t v) // NS r Increment
+int NS_r_I(struct channelf *ctx, uint8_t v) // NS r Increment
 {
-	F8_A = And8(F8_A, F8_R[F8_ISAR]);
-	incISAR();
+	ctx->F8_A = And8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
+	ctx->F8_ISAR = incISAR(ctx->F8_ISAR);
 	return 2;
 }
-int NS_r_D(uint8_t v) // NS r Decrement
+int NS_r_D(struct channelf *ctx, uint8_t v) // NS r Decrement
 {
-	F8_A = And8(F8_A, F8_R[F8_ISAR]);
-	decISAR();
+	ctx->F8_A = And8(&ctx->F8_Flags, ctx->F8_A, ctx->F8_R[ctx->F8_ISAR]);
+	ctx->F8_ISAR = decISAR(ctx->F8_ISAR);
 	return 2;
 }
 
@@ -973,23 +998,287 @@ void F8_init()
 	OpCodes[0xFF] = NOP;
 }
 
-int F8_exec(void) /* execute a single instruction */
+int F8_exec(struct channelf *ctx) /* execute a single instruction */
+{
+  	uint8_t opcode = MEMORY_read8(ctx, ctx->F8_PC0++);
+	PROFILE_COUNT(1);
+	return OpCodes[opcode](ctx, opcode);
+}
+
+/* *****************************
+   *
+   *  Switch interpreter
+   *
+   ***************************** */
+
+// Scratchpad register addressed by the low nibble of an opcode.
+// 0-B address r0-r11 directly, C-E go through ISAR (unchanged,
+// incremented, decremented), F is never passed in.
+static INLINE uint8_t *scratchpad(uint8_t *R, uint8_t opcode, uint8_t *isar)
+{
+	uint8_t *r;
+	switch(opcode&0xF)
+	{
+		case 0xC: return &R[*isar];
+		case 0xD: r = &R[*isar]; *isar = incISAR(*isar); return r;
+		case 0xE: r = &R[*isar]; *isar = decISAR(*isar); return r;
+	}
+	return &R[opcode&0xF];
+}
+
+#define SCRATCH_CASES(base) \
+	case base+0x0: case base+0x1: case base+0x2: case base+0x3: \
+	case base+0x4: case base+0x5: case base+0x6: case base+0x7: \
+	case base+0x8: case base+0x9: case base+0xA: case base+0xB: \
+	case base+0xC: case base+0xD: case base+0xE
+
+#define BRANCH(cond) \
+	{ \
+		uint8_t n = MEMORY_read8(ctx, pc0++); \
+		if(cond) { pc0 += calcBranch(n); ticks += 7; } \
+		else { ticks += 6; } \
+	}
+
+int F8_run(struct channelf *ctx, int ticks, int limit, uint16_t pc_min)
+{
+	// CPU state lives in locals for the whole run and is written
+	// back on exit, so nothing else may look at the F8_* registers
+	// until F8_run returns.
+	uint8_t *const R = ctx->F8_R;
+	uint8_t a     = ctx->F8_A;
+	struct f8_flags f = ctx->F8_Flags;
+	uint8_t isar  = ctx->F8_ISAR;
+	uint16_t pc0  = ctx->F8_PC0;
+	uint16_t pc1  = ctx->F8_PC1;
+	uint16_t dc0  = ctx->F8_DC0;
+	uint16_t dc1  = ctx->F8_DC1;
+
+	while(ticks<limit && pc0>=pc_min)
+	{
+		uint8_t opcode = MEMORY_read8(ctx, pc0++);
+
+		switch(opcode)
+		{
+			case 0x00: a = R[12]; ticks += 2; break; // LR A, Ku
+			case 0x01: a = R[13]; ticks += 2; break; // LR A, Kl
+			case 0x02: a = R[14]; ticks += 2; break; // LR A, Qu
+			case 0x03: a = R[15]; ticks += 2; break; // LR A, Ql
+			case 0x04: R[12] = a; ticks += 2; break; // LR Ku, A
+			case 0x05: R[13] = a; ticks += 2; break; // LR Kl, A
+			case 0x06: R[14] = a; ticks += 2; break; // LR Qu, A
+			case 0x07: R[15] = a; ticks += 2; break; // LR Ql, A
+			case 0x08: Store16(R, 12, pc1); ticks += 8; break; // LR K, P
+			case 0x09: pc1 = Read16(R, 12); ticks += 8; break; // LR P, K
+			case 0x0A: a = isar; ticks += 2; break; // LR A, IS
+			case 0x0B: isar = a & 0x3F; ticks += 2; break; // LR IS, A
+			case 0x0C: pc1 = pc0; pc0 = Read16(R, 12); ticks += 5; break; // PK
+			case 0x0D: pc0 = Read16(R, 14); ticks += 8; break; // LR P0, Q
+			case 0x0E: Store16(R, 14, dc0); ticks += 8; break; // LR Q, DC
+			case 0x0F: dc0 = Read16(R, 14); ticks += 8; break; // LR DC, Q
+			case 0x10: dc0 = Read16(R, 10); ticks += 8; break; // LR DC, H
+			case 0x11: Store16(R, 10, dc0); ticks += 8; break; // LR H, DC
+			case 0x12: a = ShiftRight(&f, a, 1); ticks += 2; break; // SR 1
+			case 0x13: a = ShiftLeft(&f, a, 1); ticks += 2; break;  // SL 1
+			case 0x14: a = ShiftRight(&f, a, 4); ticks += 2; break; // SR 4
+			case 0x15: a = ShiftLeft(&f, a, 4); ticks += 2; break;  // SL 4
+			case 0x16: a = MEMORY_read8(ctx, dc0++); ticks += 5; break;  // LM
+			case 0x17: MEMORY_write8(ctx, dc0++, a); ticks += 5; break;  // ST
+			case 0x18: a ^= 0xFF; setFlags_0z0s(&f, a); ticks += 2; break; // COM
+			case 0x19: a = Add8(&f, a, (getW(&f)>>flag_Carry)&1); ticks += 2; break; // LNK
+			case 0x1A: f.w &= ~(1<<flag_Interupt); ticks += 2; break; // DI
+			case 0x1B: f.w |= 1<<flag_Interupt; ticks += 2; break; // EI
+			case 0x1C: pc0 = pc1; ticks += 4; break; // POP
+			case 0x1D: setW(&f, R[9]); ticks += 2; break; // LR W, J
+			case 0x1E: R[9] = getW(&f); ticks += 4; break; // LR J, W
+			case 0x1F: a = Add8(&f, a, 1); ticks += 2; break; // INC
+			case 0x20: a = MEMORY_read8(ctx, pc0++); ticks += 5; break; // LI n
+			case 0x21: a = And8(&f, a, MEMORY_read8(ctx, pc0++)); ticks += 5; break; // NI n
+			case 0x22: a = Or8(&f, a, MEMORY_read8(ctx, pc0++)); ticks += 5; break;  // OI n
+			case 0x23: a = Xor8(&f, a, MEMORY_read8(ctx, pc0++)); ticks += 5; break; // XI n
+			case 0x24: a = Add8(&f, a, MEMORY_read8(ctx, pc0++)); ticks += 5; break; // AI n
+			case 0x25: Sub8(&f, MEMORY_read8(ctx, pc0++), a); ticks += 5; break;     // CI n
+			case 0x26: // IN n
+				a = PORTS_read(ctx, MEMORY_read8(ctx, pc0++));
+				setFlags_0z0s(&f, a);
+				ticks += 8;
+				// Polling loop: ports only change on OUT or between frames, so
+				// every further iteration reads the same value and branches back.
+				if(branchesBack(ctx, pc0, 2, &f, isar))
+				{
+					int n = loopIterations(ticks, limit, 8+7);
+					if(n)
+					{
+						ticks += (8+7) * n;
+						PROFILE_COUNT(2*n);
+					}
+				}
+				break;
+			case 0x27: // OUT n
+				ctx->CPU_Ticks = ticks; // time of the write, for audio
+				PORTS_notify(ctx, MEMORY_read8(ctx, pc0++), a);
+				ticks += 8;
+				break;
+			case 0x28: // PI mn
+			{
+				uint8_t n;
+				a = MEMORY_read8(ctx, pc0++);
+				n = MEMORY_read8(ctx, pc0++);
+				pc1 = pc0;
+				pc0 = n | (a<<8);
+				ticks += 13;
+				break;
+			}
+			case 0x29: // JMP mn
+			{
+				uint8_t n;
+				a = MEMORY_read8(ctx, pc0++);
+				n = MEMORY_read8(ctx, pc0++);
+				pc0 = n | (a<<8);
+				ticks += 11;
+				break;
+			}
+			case 0x2A: dc0 = (pc0 += 2, MEMORY_read16(ctx, pc0 - 2)); ticks += 12; break; // DCI mn
+			case 0x2C: { uint16_t t = dc0; dc0 = dc1; dc1 = t; ticks += 4; break; } // XDC
+
+			SCRATCH_CASES(0x30): // DS r
+			{
+				uint8_t *r = scratchpad(R, opcode, &isar);
+				*r = Sub8(&f, *r, 1);
+				ticks += 3;
+				// Delay loop, DS r; BNZ back to the DS: count down to the last
+				// iterations at once. ISAR must stay put for r to stay the same.
+				if(*r && opcode!=0x3D && opcode!=0x3E && MEMORY_read8(ctx, pc0)==0x94 && MEMORY_read8(ctx, pc0+1)==0xFE)
+				{
+					int n = loopIterations(ticks, limit, 7+3);
+					if(n > *r)
+					{
+						n = *r;
+					}
+					if(n)
+					{
+						*r = Sub8(&f, *r - n + 1, 1);
+						ticks += (7+3) * n;
+						PROFILE_COUNT(2*n);
+					}
+				}
+				break;
+			}
+			SCRATCH_CASES(0x40): a = *scratchpad(R, opcode, &isar); ticks += 2; break; // LR A, r
+			SCRATCH_CASES(0x50): *scratchpad(R, opcode, &isar) = a; ticks += 2; break; // LR r, A
+
+			case 0x60: case 0x61: case 0x62: case 0x63: // LISU i
+			case 0x64: case 0x65: case 0x66: case 0x67:
+				isar = (isar & 0x07) | ((opcode&0x7)<<3);
+				ticks += 2;
+				break;
+			case 0x68: case 0x69: case 0x6A: case 0x6B: // LISL i
+			case 0x6C: case 0x6D: case 0x6E: case 0x6F:
+				isar = (isar & 0x38) | (opcode&0x7);
+				ticks += 2;
+				break;
+
+			case 0x70: case 0x71: case 0x72: case 0x73: // LIS i
+			case 0x74: case 0x75: case 0x76: case 0x77:
+			case 0x78: case 0x79: case 0x7A: case 0x7B:
+			case 0x7C: case 0x7D: case 0x7E: case 0x7F:
+				a = opcode&0xF;
+				ticks += 2;
+				break;
+
+			case 0x80: case 0x81: case 0x82: case 0x83: // BT t, n (BP, BC, BZ)
+			case 0x84: case 0x85: case 0x86: case 0x87:
+				BRANCH((getW(&f) & (opcode&0x7))!=0);
+				break;
+			case 0x88: a = Add8(&f, a, MEMORY_read8(ctx, dc0++)); ticks += 5; break;   // AM
+			case 0x89: a = AddBCD(&f, a, MEMORY_read8(ctx, dc0++)); ticks += 5; break; // AMD
+			case 0x8A: a = And8(&f, a, MEMORY_read8(ctx, dc0++)); ticks += 5; break;   // NM
+			case 0x8B: a = Or8(&f, a, MEMORY_read8(ctx, dc0++)); ticks += 5; break;    // OM
+			case 0x8C: a = Xor8(&f, a, MEMORY_read8(ctx, dc0++)); ticks += 5; break;   // XM
+			case 0x8D: Sub8(&f, MEMORY_read8(ctx, dc0++), a); ticks += 5; break;       // CM
+			case 0x8E: dc0 += (int8_t)a; ticks += 5; break;                        // ADC
+			case 0x8F: BRANCH((isar&0x7)!=7); break;                               // BR7 n
+			case 0x90: { uint8_t n = MEMORY_read8(ctx, pc0++); pc0 += calcBranch(n); ticks += 7; break; } // BR n
+
+			case 0x91: case 0x92: case 0x93: case 0x94: // BF i, n (BN, BNC, BNZ, BNO)
+			case 0x95: case 0x96: case 0x97: case 0x98:
+			case 0x99: case 0x9A: case 0x9B: case 0x9C:
+			case 0x9D: case 0x9E: case 0x9F:
+				BRANCH((getW(&f) & (opcode&0xF))==0);
+				break;
+
+			case 0xA0: case 0xA1: case 0xA2: case 0xA3: // INS i
+			case 0xA4: case 0xA5: case 0xA6: case 0xA7:
+			case 0xA8: case 0xA9: case 0xAA: case 0xAB:
+			case 0xAC: case 0xAD: case 0xAE: case 0xAF:
+			{
+				const int cost = 4 + 4*((opcode&0xF)>1);
+				a = PORTS_read(ctx, opcode&0xF);
+				setFlags_0z0s(&f, a);
+				ticks += cost;
+				// polling loop, see IN
+				if(branchesBack(ctx, pc0, 1, &f, isar))
+				{
+					int n = loopIterations(ticks, limit, cost+7);
+					if(n)
+					{
+						ticks += (cost+7) * n;
+						PROFILE_COUNT(2*n);
+					}
+				}
+				break;
+			}
+
+			case 0xB0: case 0xB1: case 0xB2: case 0xB3: // OUTS i
+			case 0xB4: case 0xB5: case 0xB6: case 0xB7:
+			case 0xB8: case 0xB9: case 0xBA: case 0xBB:
+			case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+				ctx->CPU_Ticks = ticks;
+				PORTS_notify(ctx, opcode&0xF, a);
+				ticks += 4 + 4*((opcode&0xF)>1);
+				break;
+
+			SCRATCH_CASES(0xC0): a = Add8(&f, a, *scratchpad(R, opcode, &isar)); ticks += 2; break;   // AS r
+			SCRATCH_CASES(0xD0): a = AddBCD(&f, a, *scratchpad(R, opcode, &isar)); ticks += 4; break; // ASD r
+			SCRATCH_CASES(0xE0): a = Xor8(&f, a, *scratchpad(R, opcode, &isar)); ticks += 2; break;   // XS r
+			SCRATCH_CASES(0xF0): a = And8(&f, a, *scratchpad(R, opcode, &isar)); ticks += 2; break;   // NS r
+
+			default: // NOP and bad opcodes
+				ticks += 2;
+				break;
+		}
+		PROFILE_COUNT(1);
+	}
+
+	ctx->F8_A = a;
+	ctx->F8_Flags = f;
+	ctx->F8_ISAR = isar;
+	ctx->F8_PC0 = pc0;
+	ctx->F8_PC1 = pc1;
+	ctx->F8_DC0 = dc0;
+	ctx->F8_DC1 = dc1;
+
+	return ticks;
+}
+
+uint8_t F8_getW(struct channelf *ctx)
+{
+	return getW(&ctx->F8_Flags);
+}
+
+void F8_setW(struct channelf *ctx, uint8_t w)
 {
-  	uint8_t opcode = MEMORY_read8(F8_PC0++);
-	return OpCodes[opcode](opcode);
+	setW(&ctx->F8_Flags, w);
 }
 
-void F8_reset(void)
+void F8_reset(struct channelf *ctx)
 {
 	/* clear registers, flags */
-	F8_A=0;
-	F8_W=0;
-	F8_ISAR = 0;
-	F8_PC0=0; F8_PC1=0;
-	F8_DC0=0; F8_DC1=0;
+	ctx->F8_A=0;
+	setW(&ctx->F8_Flags, 0);
+	ctx->F8_ISAR = 0;
+	ctx->F8_PC0=0; ctx->F8_PC1=0;
+	ctx->F8_DC0=0; ctx->F8_DC1=0;
 
 	/* clear scratchpad */
-	memset(F8_R, 0, sizeof(F8_R));
+	memset(ctx->F8_R, 0, sizeof(ctx->F8_R));
 }
-
-
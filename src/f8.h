@@ -17,10 +17,46 @@
 	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
 */
 
-int F8_exec(void);
+#include <stdint.h>
 
-void F8_reset(void);
+struct channelf;
 
+// Status Register (flags)
+// O, Z, C and S are evaluated lazily: only the operands and result of
+// the last ALU operation are kept, and the flags are worked out when W
+// is actually read. w holds I and the unused upper bits, or the whole
+// register after it was loaded explicitly (LR W, J).
+struct f8_flags
+{
+	uint16_t r; // last ALU result, bit 8 is the carry out
+	uint8_t  a; // last ALU operands
+	uint8_t  b;
+	uint8_t  w;
+};
+
+#define FLAGS_EXPLICIT 0x8000 // r marker: O, Z, C, S are held in w
+
+// CPU interpreter used to run frames
+enum
+{
+	F8_CORE_SWITCH = 0, // inlined switch dispatch, state kept in locals
+	F8_CORE_TABLE       // one OpCodes[] call per instruction
+};
+
+int F8_exec(struct channelf *ctx);
+
+// Run instructions while ticks < limit and PC0 >= pc_min. Port writes
+// see the tick count they happen at in ctx->CPU_Ticks. Returns the
+// updated tick count.
+int F8_run(struct channelf *ctx, int ticks, int limit, uint16_t pc_min);
+
+// Status Register (flags), see F8_getW/F8_setW
+uint8_t F8_getW(struct channelf *ctx);
+void F8_setW(struct channelf *ctx, uint8_t w);
+
+void F8_reset(struct channelf *ctx);
+
+// Fill the opcode table shared by all machines, once per process
 void F8_init(void);
 
 #endif
\ No newline at end of file
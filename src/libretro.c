@@ -22,11 +22,11 @@
 #include "libretro.h"
 #include <file/file_path.h>
 #include <retro_miscellaneous.h>
-#include <retro_endianness.h>
 #include <streams/file_stream.h>
 
 #include "memory.h"
 #include "channelf.h"
+#include "f8.h"
 #include "controller.h"
 #include "audio.h"
 #include "video.h"
@@ -35,27 +35,78 @@
 #include "controller.h"
 #include "f2102.h"
 #include "channelf_hle.h"
+#include "state.h"
+#include "rewind.h"
+#include "profile.h"
 
-#define DefaultFPS 60
-#define frameHeight 192
+#define frameMaxHeight (VIDEO_HEIGHT*3)
 
 #ifdef __DJGPP__
-#define frameWidth 320
-#define framePitchPixel 320
+#define frameMaxWidth 320
+#define frameFixedPitch 320
 #elif defined(PSP)
 // Workaround for a psp1 gfx driver.
-#define framePitchPixel 320
-#define frameWidth 306
+#define frameFixedPitch 320
+#define frameMaxWidth (VIDEO_WIDTH*3)
 #else
-#define frameWidth 306
-#define framePitchPixel frameWidth
+#define frameMaxWidth (VIDEO_WIDTH*3)
 #endif
 
-#define frameSize (framePitchPixel * frameHeight)
+#ifdef frameFixedPitch
+#define frameSize (frameFixedPitch * frameMaxHeight)
+#else
+#define frameSize (frameMaxWidth * frameMaxHeight)
+#endif
+
+uint32_t frame[frameSize]; // room for frameSize pixels of any format
+static bool frame_current = false; // frame holds the last picture sent
+
+// Pixel format agreed with the frontend in retro_get_system_av_info
+static enum retro_pixel_format framePixelFormat = RETRO_PIXEL_FORMAT_XRGB8888;
+static unsigned int frameBytes = 4; // bytes per pixel
+
+// Output is the visible 102x64 scaled 1x, 2x or 3x (freechaf_video_scale)
+static unsigned int frameScale = 3;
+static unsigned int frameWidth = frameMaxWidth;
+static unsigned int frameHeight = frameMaxHeight;
+#ifdef frameFixedPitch
+static unsigned int framePitchPixel = frameFixedPitch;
+#else
+static unsigned int framePitchPixel = frameMaxWidth;
+#endif
+
+// What the OSD shows, compared between frames to find unchanged ones
+#define SHOW_SWAP    0x01 // controller swap state
+#define SHOW_SWAPPED 0x02 // ... swapped
+#define SHOW_CONSOLE 0x04 // console buttons
+#define SHOW_DOWN    0x08 // ... with the cursor pressed
+#define SHOW_CURSOR  4    // ... cursor position from this bit up
 
-pixel_t frame[frameSize];
+static int osd_shown = 0; // OSD drawn over the picture in frame
 
-struct hle_state_s hle_state;
+static bool can_dupe = false; // frontend accepts NULL for an unchanged frame
+
+// Frameskip (freechaf_frameskip) leaves frames undrawn while the
+// frontend's audio buffer runs low. The machine and audio still run
+// every frame.
+enum frameskip_mode
+{
+	FRAMESKIP_DISABLED,
+	FRAMESKIP_AUTO,      // when the frontend expects an underrun
+	FRAMESKIP_THRESHOLD  // when the buffer is below frameskipThreshold
+};
+#define FRAMESKIP_MAX 30 // frames skipped in a row at most
+
+static enum frameskip_mode frameskipMode = FRAMESKIP_DISABLED;
+static unsigned int frameskipThreshold = 33; // percent of the audio buffer
+static unsigned int frameskipCount = 0; // frames skipped in a row
+
+// Audio buffer status last reported by the frontend
+static bool audioBufferActive = false;
+static unsigned int audioBufferOccupancy = 0; // percent
+static bool audioBufferUnderrun = false;
+
+static struct channelf Machine; // the machine behind the libretro API
 
 retro_environment_t Environ;
 retro_log_printf_t log_cb;
@@ -74,6 +125,38 @@ void retro_set_environment(retro_environment_t fn)
 				"freechaf_fast_scrclr",
 				"Clear screen in single frame; disabled|enabled",
 			},
+			{
+				"freechaf_cpu_core",
+				"CPU interpreter; switch|table",
+			},
+			{
+				"freechaf_video_scale",
+				"Video output scale; 3x|2x|1x",
+			},
+			{
+				"freechaf_audio_rate",
+				"Audio sample rate; 44100|48000|32000",
+			},
+			{
+				"freechaf_frameskip",
+				"Frameskip; disabled|auto|threshold",
+			},
+			{
+				"freechaf_frameskip_threshold",
+				"Frameskip threshold (% of audio buffer); 33|20|25|30|40|50|60",
+			},
+			{
+				"freechaf_rewind",
+				"In-core rewind, hold L2 to step back; disabled|enabled",
+			},
+			{
+				"freechaf_rewind_buffer",
+				"Rewind buffer size (KB); 1024|256|512|2048|4096|8192",
+			},
+			{
+				"freechaf_state_hash",
+				"Log state hash every N frames; disabled|1|60|600|3600",
+			},
 			{ NULL, NULL },
 		};
 
@@ -89,13 +172,311 @@ void retro_set_environment(retro_environment_t fn)
 	fn(RETRO_ENVIRONMENT_SET_VARIABLES, variables);
 }
 
-static void update_variables(void)
+// Lay out the frame for an output scale and pixel format and redraw it
+// from scratch
+static void setFrameLayout(unsigned int scale, enum retro_pixel_format format)
+{
+	frameScale = scale;
+	framePixelFormat = format;
+	frameBytes = VIDEO_pixelBytes((enum video_format)format);
+	frameHeight = VIDEO_HEIGHT * scale;
+#ifndef __DJGPP__
+	frameWidth = VIDEO_WIDTH * scale;
+#endif
+#ifndef frameFixedPitch
+	framePitchPixel = frameWidth;
+#endif
+
+	memset(frame, 0, sizeof(frame));
+	VIDEO_setOutput(&Machine, (enum video_format)format, scale);
+	OSD_setDisplay(&Machine, frame, (enum video_format)format, frameWidth, frameHeight, framePitchPixel);
+	osd_shown = 0;
+	frame_current = false;
+}
+
+static void audio_buffer_status(bool active, unsigned occupancy, bool underrun_likely)
+{
+	audioBufferActive = active;
+	audioBufferOccupancy = occupancy;
+	audioBufferUnderrun = underrun_likely;
+}
+
+// Have the frontend report its audio buffer status when frameskip is on,
+// and keep enough audio buffered to skip frames against
+static void setFrameskip(enum frameskip_mode mode)
+{
+	struct retro_audio_buffer_status_callback status;
+	unsigned int latency = 0; // ms
+
+	frameskipMode = mode;
+	frameskipCount = 0;
+	audioBufferActive = false;
+	if (mode == FRAMESKIP_DISABLED)
+	{
+		Environ(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, NULL);
+	}
+	else
+	{
+		status.callback = audio_buffer_status;
+		if (Environ(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, &status))
+		{
+			// six frames, rounded up to a multiple of 32
+			latency = (6 * 1000 * CRYSTAL_PER_TICK * TICKS_PER_FRAME / CRYSTAL_HZ + 31) & ~31;
+		}
+		else
+		{
+			log_cb(RETRO_LOG_WARN, "Frontend doesn't report the audio buffer status, frameskip is off\n");
+		}
+	}
+	Environ(RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY, &latency);
+}
+
+// Whether to leave this frame undrawn
+static bool frameskip(void)
+{
+	bool skip = false;
+
+	if (!audioBufferActive || !can_dupe) // a skipped frame is sent as a dupe
+		return false;
+
+	switch(frameskipMode)
+	{
+		case FRAMESKIP_AUTO:
+			skip = audioBufferUnderrun;
+			break;
+		case FRAMESKIP_THRESHOLD:
+			skip = audioBufferOccupancy < frameskipThreshold;
+			break;
+		default:
+			break;
+	}
+	if (!skip || frameskipCount >= FRAMESKIP_MAX)
+	{
+		frameskipCount = 0;
+		return false;
+	}
+	frameskipCount++;
+	return true;
+}
+
+// In-core rewind (freechaf_rewind), stepping back while L2 is held.
+// libretro has no call for the frontend to ask a core for a step back.
+// Core options are settings read when they change, not events, and
+// handing states out through retro_serialize every frame is what rewind
+// in the core avoids. So the options turn it on and size the history,
+// L2 drives it, and each step is loaded with STATE_load like
+// retro_unserialize does.
+static struct rewind *Rewind = NULL;
+static size_t rewindCapacity = 0; // bytes, 0 when off
+
+static void setRewind(size_t capacity)
+{
+	REWIND_destroy(Rewind);
+	Rewind = NULL;
+	rewindCapacity = capacity;
+	if (capacity)
+	{
+		Rewind = REWIND_create(capacity);
+		if (!Rewind)
+			log_cb(RETRO_LOG_ERROR, "Can't allocate the rewind buffer\n");
+	}
+}
+
+// Run-ahead throws away the frames run after a state is saved to load
+// again, and a second instance runs nothing else, so those neither
+// record nor step rewind. Within one instance the run-ahead state is
+// saved incrementally into the buffer it last went to or came from. The
+// frontend owns that buffer, so the state in it has to carry the mark
+// too, or it is saved and loaded in full (see STATE_saveDirty).
+static bool speculative = false;
+static const void *runaheadState = NULL; // holds the machine at runaheadMark
+static uint32_t runaheadMark = 0;
+
+// Hash of the machine state for netplay and lockstep rigs to compare
+// without saving it. FREECHAF_MEMORY_STATE_HASH reads it as 8 bytes, most
+// significant first, kept current after every frame once it is asked
+// for. freechaf_state_hash logs it every that many frames.
+static uint8_t stateHash[8];
+static bool stateHashWanted = false;
+static unsigned int stateHashInterval = 0; // 0 for no log
+static unsigned int stateHashFrame = 0; // frames run since the game was loaded
+
+static uint64_t updateStateHash(void)
+{
+	uint64_t hash;
+	int i;
+
+	if (!stateHashWanted && !stateHashInterval)
+		return 0;
+	PROFILE_BEGIN(PROFILE_STATE);
+	hash = STATE_hash(&Machine);
+	PROFILE_END(PROFILE_STATE);
+	for (i = 0; i < 8; i++)
+		stateHash[i] = hash >> (56 - i * 8);
+	return hash;
+}
+
+// RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE bits
+#define AV_ENABLE_VIDEO            0x01
+#define AV_ENABLE_AUDIO            0x02
+
+// Frontends from before the context also ask for fast savestates for
+// netplay, so without it every state is taken as a normal one
+static int savestate_context(void)
+{
+	int context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+
+	if (Environ(RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT, &context))
+		return context;
+	return RETRO_SAVESTATE_CONTEXT_NORMAL;
+}
+
+// What update_variables changed that the frontend has to be told
+#define CHANGED_GEOMETRY 0x01 // output size
+#define CHANGED_TIMING   0x02 // audio rate
+
+static int update_variables(void)
 {
 	struct retro_variable var;
+	unsigned int scale;
+	unsigned int rate;
+	enum frameskip_mode skip;
+	size_t capacity;
+	int changed = 0;
 	var.key = "freechaf_fast_scrclr";
 	var.value = NULL;
 
-	hle_state.fast_screen_clear = (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) && strcmp(var.value, "enabled") == 0;
+	Machine.hle_state.fast_screen_clear = (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) && strcmp(var.value, "enabled") == 0;
+
+	var.key = "freechaf_cpu_core";
+	var.value = NULL;
+
+	Machine.F8_Core = ((Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) && strcmp(var.value, "table") == 0) ? F8_CORE_TABLE : F8_CORE_SWITCH;
+
+	var.key = "freechaf_video_scale";
+	var.value = NULL;
+
+	scale = 3;
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		if (strcmp(var.value, "2x") == 0)
+			scale = 2;
+		else if (strcmp(var.value, "1x") == 0)
+			scale = 1;
+	}
+	if (scale != frameScale)
+	{
+		setFrameLayout(scale, framePixelFormat);
+		changed |= CHANGED_GEOMETRY;
+	}
+
+	var.key = "freechaf_audio_rate";
+	var.value = NULL;
+
+	rate = AUDIO_DEFAULT_RATE;
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		if (strcmp(var.value, "48000") == 0)
+			rate = 48000;
+		else if (strcmp(var.value, "32000") == 0)
+			rate = 32000;
+	}
+	if (rate != Machine.AUDIO_Rate)
+	{
+		AUDIO_setRate(&Machine, rate);
+		changed |= CHANGED_TIMING;
+	}
+
+	var.key = "freechaf_frameskip";
+	var.value = NULL;
+
+	skip = FRAMESKIP_DISABLED;
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		if (strcmp(var.value, "auto") == 0)
+			skip = FRAMESKIP_AUTO;
+		else if (strcmp(var.value, "threshold") == 0)
+			skip = FRAMESKIP_THRESHOLD;
+	}
+	if (skip != frameskipMode)
+		setFrameskip(skip);
+
+	var.key = "freechaf_frameskip_threshold";
+	var.value = NULL;
+
+	frameskipThreshold = 33;
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+		frameskipThreshold = strtoul(var.value, NULL, 10);
+
+	var.key = "freechaf_rewind";
+	var.value = NULL;
+
+	capacity = 0;
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp(var.value, "enabled") == 0)
+	{
+		var.key = "freechaf_rewind_buffer";
+		var.value = NULL;
+
+		capacity = 1024;
+		if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+			capacity = strtoul(var.value, NULL, 10);
+		capacity *= 1024;
+	}
+	if (capacity != rewindCapacity)
+		setRewind(capacity);
+
+	var.key = "freechaf_state_hash";
+	var.value = NULL;
+
+	stateHashInterval = 0;
+	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+		stateHashInterval = strtoul(var.value, NULL, 10); // 0 for disabled
+	return changed;
+}
+
+// Point out and pitch at the frontend's framebuffer when it lends one in
+// our format and size for this frame, and at frame otherwise
+static bool get_framebuffer(void **out, unsigned int *pitch)
+{
+	struct retro_framebuffer fb;
+
+	*out = frame;
+	*pitch = framePitchPixel;
+
+	if (frameWidth != VIDEO_WIDTH * frameScale) // frame is wider than the picture
+		return false;
+
+	memset(&fb, 0, sizeof(fb));
+	fb.width = frameWidth;
+	fb.height = frameHeight;
+	fb.access_flags = RETRO_MEMORY_ACCESS_WRITE;
+	if (!Environ(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, &fb) || !fb.data)
+		return false;
+	if (fb.format != framePixelFormat || fb.width != frameWidth || fb.height != frameHeight ||
+	    fb.pitch % frameBytes || fb.pitch < frameWidth * frameBytes)
+		return false;
+
+	*out = fb.data;
+	*pitch = fb.pitch / frameBytes;
+	return true;
+}
+
+static void get_geometry(struct retro_game_geometry *geometry)
+{
+	geometry->base_width   = frameWidth;
+	geometry->base_height  = frameHeight;
+	geometry->max_width    = frameMaxWidth;
+	geometry->max_height   = frameMaxHeight;
+	geometry->aspect_ratio = ((float)frameWidth) / ((float)frameHeight);
+}
+
+static void get_av_info(struct retro_system_av_info *info)
+{
+	memset(info, 0, sizeof(*info));
+	get_geometry(&info->geometry);
+
+	info->timing.fps = (double)CRYSTAL_HZ / (CRYSTAL_PER_TICK * TICKS_PER_FRAME);
+	info->timing.sample_rate = Machine.AUDIO_Rate;
 }
 
 void retro_set_video_refresh(retro_video_refresh_t fn) { Video = fn; }
@@ -109,9 +490,6 @@ uint8_t joypad1[10]; // joypad 1 state
 
 bool console_input = false;
 
-// at 44.1khz, read 735 samples (44100/60) 
-static const int audioSamples = 735;
-
 static void fallback_log(enum retro_log_level level,
 			 const char *fmt, ...) {
 	va_list args;
@@ -158,56 +536,61 @@ void retro_init(void)
 
 		  Sean Riddle Multi-cart state register
 		*/
-		{RETRO_MEMDESC_SYSTEM_RAM, Memory,           0, 0x000000, 0, 0, sizeof(Memory), NULL},
-		{RETRO_MEMDESC_SYSTEM_RAM, F8_R,             0, 0x100000, 0, 0, sizeof(F8_R), NULL},
-		{RETRO_MEMDESC_SYSTEM_RAM, f2102_memory,     0, 0x200000, 0, 0, sizeof(f2102_memory), NULL},
-		{RETRO_MEMDESC_VIDEO_RAM,  VIDEO_Buffer_raw, 0, 0x300000, 0, 0, sizeof(VIDEO_Buffer_raw), NULL}
+		{RETRO_MEMDESC_SYSTEM_RAM, Machine.Memory,           0, 0x000000, 0, 0, sizeof(Machine.Memory), NULL},
+		{RETRO_MEMDESC_SYSTEM_RAM, Machine.F8_R,             0, 0x100000, 0, 0, sizeof(Machine.F8_R), NULL},
+		{RETRO_MEMDESC_SYSTEM_RAM, Machine.f2102_memory,     0, 0x200000, 0, 0, sizeof(Machine.f2102_memory), NULL},
+		{RETRO_MEMDESC_VIDEO_RAM,  Machine.VIDEO_Buffer_raw, 0, 0x300000, 0, 0, sizeof(Machine.VIDEO_Buffer_raw), NULL}
 	};
 	static struct retro_memory_map mem_map = { mem_descs, sizeof(mem_descs) / sizeof(mem_descs[0]) };
 	bool cheevos = true;
-
-	// init buffers, structs
-	memset(frame, 0, frameSize*sizeof(pixel_t));
-
-	OSD_setDisplay(frame, framePitchPixel, frameHeight);
+	uint64_t quirks = 0;
 
 	// init console
-	CHANNELF_init();
+	F8_init();
+	CHANNELF_init(&Machine);
+
+	// init buffers, structs
+	setFrameLayout(frameScale, framePixelFormat);
 
 	if (Environ(RETRO_ENVIRONMENT_GET_LOG_INTERFACE, &log))
 		log_cb = log.log;
 	else
 		log_cb = fallback_log;
 
+	if (!Environ(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe))
+		can_dupe = false;
+
+	frameskipMode = FRAMESKIP_DISABLED; // the callback is asked for again with the content
+
 	// get paths
 	Environ(RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY, &SystemPath);
 
 	// load PSU 1 Update
 	fill_pathname_join(PSU_1_Update_Path, SystemPath, "sl90025.bin", PATH_MAX_LENGTH);
-	if(!MEMORY_loadSysROM_libretro(PSU_1_Update_Path, 0))
+	if(!MEMORY_loadSysROM_libretro(&Machine, PSU_1_Update_Path, 0))
 	{
 		log_cb(RETRO_LOG_WARN, "[WARN] [FREECHAF] Failed loading Channel F II BIOS(1) from: %s\n", PSU_1_Update_Path);
 		
 		// load PSU 1 Original
 		fill_pathname_join(PSU_1_Path, SystemPath, "sl31253.bin", PATH_MAX_LENGTH);
-		if(!MEMORY_loadSysROM_libretro(PSU_1_Path, 0))
+		if(!MEMORY_loadSysROM_libretro(&Machine, PSU_1_Path, 0))
 		{
 			log_cb(RETRO_LOG_WARN, "[WARN] [FREECHAF] Failed loading Channel F BIOS(1) from: %s\n", PSU_1_Path);
 			log_cb(RETRO_LOG_WARN, "[WARN] [FREECHAF] Switching to HLE for PSU1\n");
-			hle_state.psu1_hle = true;
+			Machine.hle_state.psu1_hle = true;
 		}
 	}
 
 	// load PSU 2
 	fill_pathname_join(PSU_2_Path, SystemPath, "sl31254.bin", PATH_MAX_LENGTH);
-	if(!MEMORY_loadSysROM_libretro(PSU_2_Path, 0x400))
+	if(!MEMORY_loadSysROM_libretro(&Machine, PSU_2_Path, 0x400))
 	{
 		log_cb(RETRO_LOG_WARN, "[WARN] [FREECHAF] Failed loading Channel F BIOS(2) from: %s\n", PSU_2_Path);
 		log_cb(RETRO_LOG_WARN, "[WARN] [FREECHAF] Switching to HLE for PSU2\n");
-		hle_state.psu2_hle = true;
+		Machine.hle_state.psu2_hle = true;
 	}
 
-	if (hle_state.psu1_hle || hle_state.psu2_hle)
+	if (Machine.hle_state.psu1_hle || Machine.hle_state.psu2_hle)
 	{
 			struct retro_message msg;
 			msg.msg    = "Couldn't load BIOS. Using experimental HLE mode. In case of problem please use BIOS";
@@ -217,6 +600,9 @@ void retro_init(void)
 
 	Environ(RETRO_ENVIRONMENT_SET_MEMORY_MAPS, &mem_map);
 
+	// states are complete, the same size for a cart and big endian
+	Environ(RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS, &quirks);
+
 	Environ(RETRO_ENVIRONMENT_SET_SUPPORT_ACHIEVEMENTS, &cheevos);
 }
 
@@ -233,6 +619,7 @@ bool retro_load_game(const struct retro_game_info *info)
 		{ 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y,     "rotate left" },
 		{ 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT,"swap left/right controllers" },
 		{ 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START, "swap console/controller input" },
+		{ 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L2,    "rewind" },
 
 		{ 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT,  "left" },
 		{ 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP,    "forward" },
@@ -244,12 +631,16 @@ bool retro_load_game(const struct retro_game_info *info)
 		{ 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y,     "rotate left" },
 		{ 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT,"swap left/right controllers" },
 		{ 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START, "swap console/controller input" },
+		{ 1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L2,    "rewind" },
 
 		{ 0 },
 	};
 
 	update_variables();
-	if (!MEMORY_loadCartROM(info->data, info->size))
+	if (!info)
+		return false;
+	if (!(info->path && MEMORY_loadCartFile(&Machine, info->path)) &&
+	    !(info->data && MEMORY_loadCartROM(&Machine, info->data, info->size)))
 		return false;
 
 	Environ(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
@@ -259,28 +650,53 @@ bool retro_load_game(const struct retro_game_info *info)
 
 void retro_unload_game(void)
 {
-	
+	if (Rewind)
+		REWIND_clear(Rewind);
+	speculative = false;
+	runaheadState = NULL;
+	runaheadMark = 0;
+	stateHashFrame = 0;
+	MEMORY_unloadCartROM(&Machine);
 }
 
 void retro_run(void)
 {
 	int i = 0;
-	int offset = 0;
-	int color = 0;
-	int row;
-	int col;
+	int osd;
+	void *out;
+	unsigned int pitch;
+	bool direct;
+	bool rewinding;
+	int enable = AV_ENABLE_VIDEO | AV_ENABLE_AUDIO;
 
 	bool updated = false;
+	int changed;
+	struct retro_system_av_info av;
 	uint8_t joypre0[10]; // joypad 0 previous state
 	uint8_t joypre1[10]; // joypad 1 previous state
 
 	if (Environ(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
 	{
-		update_variables();
+		changed = update_variables();
+		if (changed & CHANGED_TIMING)
+		{
+			get_av_info(&av);
+			Environ(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &av);
+		}
+		else if (changed & CHANGED_GEOMETRY)
+		{
+			get_av_info(&av);
+			Environ(RETRO_ENVIRONMENT_SET_GEOMETRY, &av.geometry);
+		}
 	}
 
 	InputPoll();
 
+	// hidden run-ahead frames are neither heard nor seen
+	if (!Environ(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &enable))
+		enable = AV_ENABLE_VIDEO | AV_ENABLE_AUDIO;
+	Machine.AUDIO_Muted = !(enable & AV_ENABLE_AUDIO);
+
 	for(i=0; i<sizeof(joypre0)/sizeof(joypre0[0]); i++) // Copy previous state 
 	{
 		joypre0[i] = joypad0[i];
@@ -317,6 +733,9 @@ void retro_run(void)
 	joypad1[8] = !!InputState(1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START);
 	joypad1[9] = !!InputState(1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT);
 
+	rewinding = Rewind && (InputState(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L2) ||
+	                       InputState(1, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L2));
+
 	// swap console/controller input //
 	if((joypad0[8]==1 && joypre0[8]==0) || (joypad1[8]==1 && joypre1[8]==0))
 	{
@@ -326,37 +745,37 @@ void retro_run(void)
 	// swap left/right controllers //
 	if((joypad0[9]==1 && joypre0[9]==0) || (joypad1[9]==1 && joypre1[9]==0))
 	{
-		CONTROLLER_swap();
+		CONTROLLER_swap(&Machine);
 	}
 
 	if(console_input) // console input
 	{
 		if(((joypad0[2]==1 && joypre0[2]==0) || (joypad1[2]==1 && joypre1[2]==0)))  // left
 		{
-			CONTROLLER_consoleInput(0, 1);
+			CONTROLLER_consoleInput(&Machine, 0, 1);
 		}
 
 		if(((joypad0[3]==1 && joypre0[3]==0) || (joypad1[3]==1 && joypre1[3]==0))) // right
 		{
-			CONTROLLER_consoleInput(1, 1);
+			CONTROLLER_consoleInput(&Machine, 1, 1);
 		}
 
 		for(i=4; i<8; i++)
 		{
 			if((joypad0[i]==1 && joypre0[i]==0) || (joypad1[i]==1 && joypre1[i]==0)) // a,b,x,y
 			{
-				CONTROLLER_consoleInput(2, 1);
+				CONTROLLER_consoleInput(&Machine, 2, 1);
 			}
 			if((joypad0[i]==0 && joypre0[i]==1) || (joypad1[i]==0 && joypre1[i]==1)) // a,b,x,y
 			{
-				CONTROLLER_consoleInput(2, 0);
+				CONTROLLER_consoleInput(&Machine, 2, 0);
 			}
 		}
 	}
 	else
 	{
 		// ordinary controller input
-		CONTROLLER_setInput(1,
+		CONTROLLER_setInput(&Machine, 1,
 		(joypad0[5]<<7)|               /* push         - B    - ALeft Down  -         */
 		(joypad0[6]<<6)|               /* pull         - X    - ALeft Up    -         */
 		(joypad0[4]<<5)|               /* rotate right - A    - ALeft Right - ShRight */
@@ -366,7 +785,7 @@ void retro_run(void)
 		(joypad0[2]<<1)|               /* left         - Left - ARight Left -         */
 		(joypad0[3]) );                /* right        - Right- ARight Right-         */
 
-		CONTROLLER_setInput(2,
+		CONTROLLER_setInput(&Machine, 2,
 		(joypad1[5]<<7)|               /* push         - B    - ALeft Down  -         */
 		(joypad1[6]<<6)|               /* pull         - X    - ALeft Up    -         */
 		(joypad1[4]<<5)|               /* rotate right - A    - ALeft Right - ShRight */
@@ -377,62 +796,108 @@ void retro_run(void)
 		(joypad1[3]) );                /* right        - Right- ARight Right-         */
 	}
 
-	// grab frame
-	if(hle_state.psu1_hle || hle_state.psu2_hle || hle_state.fast_screen_clear)
+	// grab frame, or go back one while rewinding, which stays on the
+	// oldest frame when there is none left. Run-ahead frames show the
+	// frame stepped back to.
+	if(rewinding)
 	{
-		CHANNELF_HLE_run();
+		if(!speculative)
+		{
+			PROFILE_BEGIN(PROFILE_STATE);
+			REWIND_step(Rewind, &Machine);
+			PROFILE_END(PROFILE_STATE);
+		}
+		memset(Machine.AUDIO_Buffer, 0, Machine.AUDIO_Samples * 2 * sizeof(int16_t));
 	}
 	else
 	{
-		CHANNELF_run();
+		if(Machine.hle_state.psu1_hle || Machine.hle_state.psu2_hle || Machine.hle_state.fast_screen_clear)
+		{
+			CHANNELF_HLE_run(&Machine);
+		}
+		else
+		{
+			CHANNELF_run(&Machine);
+		}
+		if(Rewind && !speculative)
+		{
+			PROFILE_BEGIN(PROFILE_STATE);
+			REWIND_push(Rewind, &Machine);
+			PROFILE_END(PROFILE_STATE);
+		}
 	}
-
-	AudioBatch (AUDIO_Buffer, audioSamples);
-	AUDIO_frame(); // notify audio to start new audio frame
-
-	// send frame to libretro
-	VIDEO_drawFrame();
-	// 3x upscale (gives more resolution for OSD)
-	offset = 0;
-	color = 0;
-	for(row=0; row<64; row++)
+	if(!speculative)
 	{
-		offset = (row*3)*framePitchPixel;
-		for(col=0; col<102; col++)
+		uint64_t hash = updateStateHash();
+
+		stateHashFrame++;
+		if(stateHashInterval && stateHashFrame % stateHashInterval == 0)
 		{
-			color =  VIDEO_Buffer_rgb[row*128+col+4];
-			frame[offset]   = color;
-			frame[offset+1] = color;
-			frame[offset+2] = color;
-
-			frame[offset+framePitchPixel] = color;
-			frame[offset+framePitchPixel+1] = color;
-			frame[offset+framePitchPixel+2] = color;
-
-			frame[offset+2*framePitchPixel] = color;
-			frame[offset+2*framePitchPixel+1] = color;
-			frame[offset+2*framePitchPixel+2] = color;
-			offset+=3;
+			log_cb(RETRO_LOG_INFO, "[FREECHAF] Frame %u state hash %016llx\n", stateHashFrame, (unsigned long long)hash);
 		}
 	}
-	// OSD
+
+	if(!Machine.AUDIO_Muted)
+	{
+		AudioBatch (Machine.AUDIO_Buffer, Machine.AUDIO_Samples);
+	}
+
+	// Hidden and skipped frames leave VIDEO_Dirty set, the next frame
+	// drawn catches up
+	if(!(enable & AV_ENABLE_VIDEO) || frameskip())
+	{
+		Video(NULL, frameWidth, frameHeight, frameBytes * framePitchPixel);
+		return;
+	}
+
+	// OSD for this frame
+	osd = 0;
 	if((joypad0[9]==1) || (joypad1[9]==1)) // Show Controller Swap State 
 	{
-		if(CONTROLLER_swapped())
+		osd |= SHOW_SWAP | (CONTROLLER_swapped(&Machine) ? SHOW_SWAPPED : 0);
+	}
+	if(console_input) // Show Console Buttons
+	{
+		osd |= SHOW_CONSOLE | (CONTROLLER_cursorDown(&Machine) ? SHOW_DOWN : 0) | (CONTROLLER_cursorPos(&Machine) << SHOW_CURSOR);
+	}
+
+	if(!Machine.VIDEO_Dirty && !osd && !osd_shown && (can_dupe || frame_current)) // frame is unchanged
+	{
+		Video(can_dupe ? NULL : frame, frameWidth, frameHeight, frameBytes * framePitchPixel);
+		return;
+	}
+
+	// send frame to libretro, upscaled by frameScale (more resolution for OSD).
+	// The frontend's framebuffer holds nothing drawn before, so the whole
+	// picture goes into it. In frame only the changed rows and those under
+	// the OSD of the last frame are drawn again.
+	direct = get_framebuffer(&out, &pitch);
+	PROFILE_BEGIN(PROFILE_VIDEO);
+	VIDEO_drawFrame(&Machine, out, pitch, (direct || !frame_current || osd_shown) ? ~(uint64_t)0 : 0);
+	PROFILE_END(PROFILE_VIDEO);
+	frame_current = !direct;
+	OSD_setDisplay(&Machine, out, (enum video_format)framePixelFormat, frameWidth, frameHeight, pitch);
+	// OSD
+	PROFILE_BEGIN(PROFILE_OSD);
+	if(osd & SHOW_SWAP)
+	{
+		if(osd & SHOW_SWAPPED)
 		{
-			OSD_drawP1P2();
+			OSD_drawP1P2(&Machine);
 		}
 		else
 		{
-			OSD_drawP2P1();
+			OSD_drawP2P1(&Machine);
 		}
 	}
-	if(console_input) // Show Console Buttons
+	if(osd & SHOW_CONSOLE)
 	{
-		 OSD_drawConsole(CONTROLLER_cursorPos(), CONTROLLER_cursorDown());
+		 OSD_drawConsole(&Machine, osd >> SHOW_CURSOR, (osd & SHOW_DOWN) != 0);
 	}
+	osd_shown = osd;
+	PROFILE_END(PROFILE_OSD);
 	// Output video
-	Video(frame, frameWidth, frameHeight, sizeof(pixel_t) * framePitchPixel);
+	Video(out, frameWidth, frameHeight, frameBytes * pitch);
 }
 
 unsigned retro_get_region(void)
@@ -449,235 +914,161 @@ void retro_get_system_info(struct retro_system_info *info)
 #endif
 	info->library_version = "1.0" GIT_VERSION;
 	info->valid_extensions = "bin|rom|chf";
-	info->need_fullpath = false;
+	info->need_fullpath = true;
 }
 
-void retro_get_system_av_info(struct retro_system_av_info *info)
+// Formats to ask the frontend for, best first. 16 bit builds start with
+// RGB565. 0RGB1555 is what the frontend uses when it accepts none.
+static const enum retro_pixel_format pixelFormats[] =
 {
 #ifdef USE_RGB565
-	int pixelformat = RETRO_PIXEL_FORMAT_RGB565;
+	RETRO_PIXEL_FORMAT_RGB565,
+	RETRO_PIXEL_FORMAT_XRGB8888,
 #else
-	int pixelformat = RETRO_PIXEL_FORMAT_XRGB8888;
-#endif	
+	RETRO_PIXEL_FORMAT_XRGB8888,
+	RETRO_PIXEL_FORMAT_RGB565,
+#endif
+	RETRO_PIXEL_FORMAT_0RGB1555
+};
 
-	memset(info, 0, sizeof(*info));
-	info->geometry.base_width   = frameWidth;
-	info->geometry.base_height  = frameHeight;
-	info->geometry.max_width    = frameWidth;
-	info->geometry.max_height   = frameHeight;
-	info->geometry.aspect_ratio = ((float)frameWidth) / ((float)frameHeight);
+void retro_get_system_av_info(struct retro_system_av_info *info)
+{
+	enum retro_pixel_format format = RETRO_PIXEL_FORMAT_0RGB1555;
+	unsigned int i;
 
-	info->timing.fps = DefaultFPS;
-	info->timing.sample_rate = 44100.0;
+	for(i=0; i<sizeof(pixelFormats)/sizeof(pixelFormats[0]); i++)
+	{
+		format = pixelFormats[i];
+		if (Environ(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &format))
+			break;
+	}
+	if (i == sizeof(pixelFormats)/sizeof(pixelFormats[0]))
+		format = RETRO_PIXEL_FORMAT_0RGB1555;
+	if (format != framePixelFormat)
+		setFrameLayout(frameScale, format);
 
-	Environ(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixelformat);
+	get_av_info(info);
 }
 
 
-void retro_deinit(void) {  }
-
-void retro_reset(void)
+void retro_deinit(void)
 {
-	CHANNELF_reset();
+	setRewind(0);
+	CHANNELF_deinit(&Machine);
 }
 
-struct serialized_state
+void retro_reset(void)
 {
-	unsigned int CPU_Ticks_Debt;
-	uint8_t Memory[MEMORY_SIZE];
-	uint8_t F8_R[R_SIZE]; // 64 byte Scratchpad
-	uint8_t VIDEO_Buffer[8192];
-	uint8_t Ports[64];
-
-	uint16_t F8_PC0; // Program Counter
-	uint16_t F8_PC1; // Program Counter alternate
-	uint16_t F8_DC0; // Data Counter
-	uint16_t F8_DC1; // Data Counter alternate
-	uint8_t F8_ISAR; // Indirect Scratchpad Address Register (6-bit)
-	uint8_t F8_W; // Status Register (flags)
-
-	uint16_t f2102_state;
-	uint8_t f2102_memory[1024];
-	uint16_t f2102_address;
-	uint8_t f2102_rw;
-	uint8_t F8_A; // Accumulator
-
-	uint8_t VIDEO_ARM, VIDEO_X, VIDEO_Y, VIDEO_Color;
-	uint8_t ControllerEnabled;
-	uint8_t ControllerSwapped;
-
-	uint8_t console_input;
-	uint8_t AUDIO_tone;
-	uint16_t AUDIO_amp;
-
-	struct hle_state_s hle_state;
-
-	unsigned int cursorX;
-	unsigned int cursorDown;
-
-	unsigned int AUDIO_sampleInCycle;
-	unsigned int AUDIO_ticks;
-
-	uint8_t joypad0[10]; // joypad 0 state
-	uint8_t joypad1[10]; // joypad 1 state
-
-	uint8_t CONTROLLER_State[3];
-	uint8_t MEMORY_Multicart;
-};
+	CHANNELF_reset(&Machine);
+	updateStateHash();
+}
 
 size_t retro_serialize_size(void)
 {
-	return sizeof (struct serialized_state);
+	return STATE_size(&Machine);
 }
 
 bool retro_serialize(void *data, size_t size)
 {
-  	struct serialized_state *st = data;
-	unsigned int i;
-
-	if (size < sizeof (struct serialized_state))
-		return false;
-
-	memcpy(st->Memory, Memory, MEMORY_SIZE);
-	memcpy(st->F8_R, F8_R, R_SIZE);
-	memcpy(st->VIDEO_Buffer, VIDEO_Buffer_raw, sizeof(VIDEO_Buffer_raw));
-	memcpy(st->Ports, Ports, sizeof(Ports));
-	memcpy(st->f2102_memory, f2102_memory, sizeof(f2102_memory));
-
-	st->F8_A = F8_A;
-	st->F8_ISAR = F8_ISAR;
-	st->F8_W = F8_W;
-
-	st->F8_PC0 = retro_cpu_to_be16(F8_PC0);
-	st->F8_PC1 = retro_cpu_to_be16(F8_PC1);
-	st->F8_DC0 = retro_cpu_to_be16(F8_DC0);
-	st->F8_DC1 = retro_cpu_to_be16(F8_DC1);
-
-	st->VIDEO_X = VIDEO_X;
-	st->VIDEO_Y = VIDEO_Y;
-	st->VIDEO_Color = VIDEO_Color;
-	st->VIDEO_ARM = VIDEO_ARM;
-
-	st->f2102_rw = f2102_rw;
-	st->f2102_address = retro_cpu_to_be16(f2102_address);
-	st->f2102_state = retro_cpu_to_be16(f2102_state);
-
-	st->ControllerEnabled = ControllerEnabled;
-	st->ControllerSwapped = ControllerSwapped;
-	st->console_input = console_input;
-
-	st->AUDIO_tone = AUDIO_tone;
-	st->AUDIO_amp = retro_cpu_to_be16(AUDIO_amp);
-	st->AUDIO_sampleInCycle = retro_cpu_to_be32(AUDIO_sampleInCycle);
-	st->AUDIO_ticks = retro_cpu_to_be32(AUDIO_ticks);
+	struct state_host host;
+	size_t used;
 
-	st->hle_state = hle_state;
-	st->CPU_Ticks_Debt = retro_cpu_to_be32(CPU_Ticks_Debt);
+	host.console_input = console_input;
+	memcpy(host.joypad0, joypad0, sizeof(host.joypad0));
+	memcpy(host.joypad1, joypad1, sizeof(host.joypad1));
 
-	st->cursorX = retro_cpu_to_be32(cursorX);
-	st->cursorDown = retro_cpu_to_be32(cursorDown);
-
-	for(i=0; i<sizeof(joypad0)/sizeof(joypad0[0]); i++)
+	PROFILE_BEGIN(PROFILE_STATE);
+	if (savestate_context() == RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE)
 	{
-		st->joypad0[i] = joypad0[i];
-		st->joypad1[i] = joypad1[i];
+		// the frames run until it's loaded again are thrown away
+		speculative = true;
+		if (data != runaheadState)
+			runaheadMark = 0;
+		runaheadState = data;
+		used = STATE_saveDirty(&Machine, &host, data, size, &runaheadMark);
 	}
-
-	memcpy(st->CONTROLLER_State, CONTROLLER_State, sizeof(st->CONTROLLER_State));
-
-	st->MEMORY_Multicart = MEMORY_Multicart;
-
-	return true;
+	else
+	{
+		used = STATE_save(&Machine, &host, data, size);
+	}
+	PROFILE_END(PROFILE_STATE);
+	return used != 0;
 }
 
 bool retro_unserialize(const void *data, size_t size)
 {
-  	const struct serialized_state *st = data;
-
-	if (size < sizeof (struct serialized_state) - 41)
+	struct state_host host;
+	int context;
+	int loaded;
+
+	host.console_input = console_input;
+	memcpy(host.joypad0, joypad0, sizeof(host.joypad0));
+	memcpy(host.joypad1, joypad1, sizeof(host.joypad1));
+
+	// a run-ahead state only differs where the machine was written since
+	context = savestate_context();
+	PROFILE_BEGIN(PROFILE_STATE);
+	if (context == RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE && data == runaheadState && runaheadMark)
+		loaded = STATE_loadDirty(&Machine, &host, data, size, runaheadMark);
+	else
+		loaded = STATE_load(&Machine, &host, data, size);
+	PROFILE_END(PROFILE_STATE);
+	if (!loaded)
 		return false;
 
-	memcpy (Memory, st->Memory, MEMORY_SIZE);
-	memcpy (F8_R, st->F8_R, R_SIZE);
-	memcpy (VIDEO_Buffer_raw, st->VIDEO_Buffer, sizeof(VIDEO_Buffer_raw));
-	memcpy (Ports, st->Ports, sizeof(Ports));
-	memcpy (f2102_memory, st->f2102_memory, sizeof(f2102_memory));
-
-	F8_A = st->F8_A;
-	F8_ISAR = st->F8_ISAR;
-	F8_W = st->F8_W;
-
-	F8_PC0 = retro_be_to_cpu16(st->F8_PC0);
-	F8_PC1 = retro_be_to_cpu16(st->F8_PC1);
-	F8_DC0 = retro_be_to_cpu16(st->F8_DC0);
-	F8_DC1 = retro_be_to_cpu16(st->F8_DC1);
-
-	VIDEO_X = st->VIDEO_X;
-	VIDEO_Y = st->VIDEO_Y;
-	VIDEO_Color = st->VIDEO_Color;
-	VIDEO_ARM = st->VIDEO_ARM;
-
-	f2102_rw = st->f2102_rw;
-	f2102_address = retro_be_to_cpu16(st->f2102_address);
-	f2102_state = retro_be_to_cpu16(st->f2102_state);
-
-	ControllerEnabled = st->ControllerEnabled;
-	ControllerSwapped = st->ControllerSwapped;
-
-	console_input = st->console_input;
-	hle_state = st->hle_state;
-
-	AUDIO_tone = st->AUDIO_tone;
-	AUDIO_amp = retro_be_to_cpu16(st->AUDIO_amp);
-	CPU_Ticks_Debt = retro_be_to_cpu32(st->CPU_Ticks_Debt);
-
-	if (size >= sizeof (struct serialized_state))
+	switch (context)
 	{
-		unsigned i;
-
-		cursorX = retro_be_to_cpu16(st->cursorX);
-		cursorDown = retro_be_to_cpu16(st->cursorDown);
-
-		AUDIO_sampleInCycle = retro_be_to_cpu32(st->AUDIO_sampleInCycle);
-		AUDIO_ticks = retro_be_to_cpu32(st->AUDIO_ticks);
-
-		for(i=0; i<sizeof(joypad0)/sizeof(joypad0[0]); i++)
-		{
-			joypad0[i] = st->joypad0[i];
-			joypad1[i] = st->joypad1[i];
-		}
-
-		memcpy(CONTROLLER_State, st->CONTROLLER_State, sizeof(st->CONTROLLER_State));
-
-		MEMORY_Multicart = st->MEMORY_Multicart;
-	} else {
-		hle_state.delay_counter = 0;
+		case RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE:
+			// back on the frames that count. The next save goes into data
+			// again, which still holds the state saved at runaheadMark.
+			speculative = false;
+			if (data != runaheadState)
+				runaheadMark = 0;
+			runaheadState = data;
+			break;
+		case RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_BINARY:
+			speculative = true; // this instance only runs ahead
+			break;
+		default:
+			speculative = false;
+			if (Rewind)
+				REWIND_clear(Rewind);
+			break;
 	}
+	if (!speculative)
+		updateStateHash();
 
+	console_input = host.console_input;
+	memcpy(joypad0, host.joypad0, sizeof(joypad0));
+	memcpy(joypad1, host.joypad1, sizeof(joypad1));
 	return true;
 }
 
 #define FREECHAF_MEMORY_MEMBUS 0x100
 #define FREECHAF_MEMORY_F2102 0x101
+#define FREECHAF_MEMORY_STATE_HASH 0x102 // read only, see updateStateHash
 
 size_t retro_get_memory_size(unsigned id)
 {
 	switch(id)
 	{
 		case RETRO_MEMORY_SYSTEM_RAM: // System Memory
-			return sizeof(F8_R);
+			return sizeof(Machine.F8_R);
 	
 		case RETRO_MEMORY_VIDEO_RAM: // Video Memory
-			return sizeof(VIDEO_Buffer_raw); //8192
+			return sizeof(Machine.VIDEO_Buffer_raw); //8192
 
 		//case RETRO_MEMORY_SAVE_RAM: // SRAM / Regular save RAM
 		//case RETRO_MEMORY_RTC: // Real-time clock value
 
 	        case FREECHAF_MEMORY_MEMBUS:
-			return sizeof(Memory);
+			return sizeof(Machine.Memory);
 
 	        case FREECHAF_MEMORY_F2102:
-			return sizeof(f2102_memory);
+			return sizeof(Machine.f2102_memory);
+
+	        case FREECHAF_MEMORY_STATE_HASH:
+			return sizeof(stateHash);
 
 	}
 	return 0;
@@ -688,19 +1079,27 @@ void *retro_get_memory_data(unsigned id)
 	switch(id)
 	{
 		case RETRO_MEMORY_SYSTEM_RAM: // System Memory
-			return F8_R;
+			return Machine.F8_R;
 	
 		case RETRO_MEMORY_VIDEO_RAM: // Video Memory
-			return VIDEO_Buffer_raw;
+			return Machine.VIDEO_Buffer_raw;
 
 		//case RETRO_MEMORY_SAVE_RAM: // SRAM / Regular save RAM
 		//case RETRO_MEMORY_RTC: // Real-time clock value
 
 	        case FREECHAF_MEMORY_MEMBUS:
-			return Memory;
+			return Machine.Memory;
 
 	        case FREECHAF_MEMORY_F2102:
-			return f2102_memory;
+			return Machine.f2102_memory;
+
+	        case FREECHAF_MEMORY_STATE_HASH:
+			if (!stateHashWanted)
+			{
+				stateHashWanted = true;
+				updateStateHash();
+			}
+			return stateHash;
 	}
 	return 0;
 }
@@ -18,16 +18,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <streams/file_stream.h>
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "memory.h"
 
-int MEMORY_RAMStart;
-uint8_t Memory[MEMORY_SIZE];
-static uint8_t *ROM;
-static uint32_t ROMSize;
-static int is_multicart;
-uint8_t MEMORY_Multicart;
-
-int MEMORY_loadSysROM_libretro(const char* path, int address)
+int MEMORY_loadSysROM_libretro(struct channelf *ctx, const char* path, int address)
 {
 	RFILE *h = filestream_open(path, RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE);
 	ssize_t size;
@@ -46,84 +45,267 @@ int MEMORY_loadSysROM_libretro(const char* path, int address)
 		size = MEMORY_SIZE - address;
 	}
 
-	size = filestream_read(h, Memory + address, size);
+	size = filestream_read(h, ctx->Memory + address, size);
 	filestream_close(h);
 	if (size <= 0) // problem reading file
 	{
 		return 0;
 	}
 
-	if (address+size>MEMORY_RAMStart) 
+	if (address+size>ctx->MEMORY_RAMStart) 
+	{
+		ctx->MEMORY_RAMStart = address+size;
+	}
+	if (address+size>ctx->SysROMEnd)
 	{
-		MEMORY_RAMStart = address+size;
+		ctx->SysROMEnd = address+size;
 	}
+	MEMORY_remap(ctx);
 
 	return 1;
 }
 
-int MEMORY_loadCartROM(const void* data, size_t size)
+static int isMulticart(size_t size)
+{
+	return size == (1 << 18); // Sean Riddle multicart
+}
+
+// Take ownership of a cart image, malloc'd or mapped
+static void setCartROM(struct channelf *ctx, uint8_t *rom, size_t size, int mapped)
 {
 	const uint16_t address = 0x800;
 	int length = size;
-	if (size == (1 << 18)) { // Sean Riddle multicart
+
+	ctx->ROM = rom;
+	ctx->ROMSize = size;
+	ctx->ROMMapped = mapped;
+	ctx->is_multicart = isMulticart(size);
+	if (ctx->is_multicart) {
 		length = 0x1800;
-		is_multicart = 1;
-	} else {
-		is_multicart = 0;
 	}
-	ROM = malloc(size);
-	if (!ROM) {
+		
+	if (address+length>ctx->MEMORY_RAMStart) { ctx->MEMORY_RAMStart = address+length; }
+	MEMORY_remap(ctx);
+}
+
+int MEMORY_loadCartROM(struct channelf *ctx, const void* data, size_t size)
+{
+	uint8_t *rom;
+
+	MEMORY_unloadCartROM(ctx);
+	rom = malloc(size);
+	if (!rom) {
 		return 0;
 	}
+	memcpy(rom, data, size);
+	setCartROM(ctx, rom, size, 0);
 
-	ROMSize = size;
-	memcpy(ROM, data, size);
-		
-	if (address+length>MEMORY_RAMStart) { MEMORY_RAMStart = address+length; }
+	return 1;
+}
+
+int MEMORY_loadCartFile(struct channelf *ctx, const char* path)
+{
+	void *data = NULL;
+	int64_t size = 0;
+
+	MEMORY_unloadCartROM(ctx);
+
+#ifdef HAVE_MMAP
+	{
+		// Plain carts are mapped read-only and shared between instances.
+		// A multicart keeps its RAM (0x2000 and up) in the image, so it
+		// gets a private copy-on-write mapping instead.
+		int fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size > 0) {
+				int prot = PROT_READ;
+				if (isMulticart(st.st_size))
+					prot |= PROT_WRITE;
+				data = mmap(NULL, st.st_size, prot, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED) {
+					close(fd);
+					setCartROM(ctx, data, st.st_size, 1);
+					return 1;
+				}
+			}
+			close(fd);
+		}
+	}
+#endif
+
+	// not a local file or no mmap, read it through the VFS
+	if (!filestream_read_file(path, &data, &size) || size <= 0) {
+		free(data);
+		return 0;
+	}
+	setCartROM(ctx, data, size, 0);
 
 	return 1;
 }
 
-static uint8_t *translate(uint16_t address)
+void MEMORY_unloadCartROM(struct channelf *ctx)
+{
+	if (ctx->ROM) {
+#ifdef HAVE_MMAP
+		if (ctx->ROMMapped)
+			munmap(ctx->ROM, ctx->ROMSize);
+		else
+#endif
+			free(ctx->ROM);
+	}
+	ctx->ROM = NULL;
+	ctx->ROMSize = 0;
+	ctx->ROMMapped = 0;
+	ctx->is_multicart = 0;
+	ctx->MEMORY_RAMStart = ctx->SysROMEnd;
+	MEMORY_remap(ctx);
+}
+
+static uint8_t *translate(struct channelf *ctx, uint16_t address)
 {
-	if (address >= 0x800 && address < 0x2000 && is_multicart) {
-		uint32_t mapped = (address - 0x800) | ((MEMORY_Multicart & 0x1f) << 13) | ((MEMORY_Multicart & 0x20) << 7);
-		if (mapped < ROMSize)
-			return &ROM[mapped];
+	if (address >= 0x800 && address < 0x2000 && ctx->is_multicart) {
+		return &ctx->ROM[(address - 0x800) | ctx->BankOffset];
 	}
-	if (address >= 0x800 && address < (0x800 + ROMSize)) {
-		return &ROM[address - 0x800];
+	if (address >= 0x800 && address < (0x800 + ctx->ROMSize)) {
+		return &ctx->ROM[address - 0x800];
 	}
-	return &Memory[address];
+	return &ctx->Memory[address];
 }
 
-uint8_t MEMORY_read8(uint16_t address)
+// Backing memory of a whole page, or NULL if the page is split
+// between ROM and RAM. Mirrors translate().
+static uint8_t *pageBase(struct channelf *ctx, uint32_t address)
 {
-	uint8_t *ta = translate(address);
+	if (address >= 0x800 && address < 0x2000 && ctx->is_multicart) {
+		return &ctx->ROM[(address - 0x800) | ctx->BankOffset];
+	}
+	if (address >= 0x800 && address - 0x800 + MEMORY_PAGE_SIZE <= ctx->ROMSize) {
+		return &ctx->ROM[address - 0x800];
+	}
+	if (address + MEMORY_PAGE_SIZE <= 0x800 || address - 0x800 >= ctx->ROMSize) {
+		return &ctx->Memory[address];
+	}
+	return NULL;
+}
+
+// Only the cart read pages change with the bank, writes there are
+// dropped whatever the bank.
+static void selectBank(struct channelf *ctx)
+{
+	uint32_t address;
+
+	ctx->BankOffset = ((ctx->MEMORY_Multicart & 0x1f) << 13) | ((ctx->MEMORY_Multicart & 0x20) << 7);
+	if (!ctx->is_multicart)
+		return;
+	for (address = 0x800; address < 0x2000; address += MEMORY_PAGE_SIZE)
+		ctx->MEMORY_ReadMap[address >> MEMORY_PAGE_SHIFT] = pageBase(ctx, address);
+}
+
+void MEMORY_remap(struct channelf *ctx)
+{
+	uint32_t page;
+
+	selectBank(ctx);
+	for (page = 0; page < MEMORY_PAGES; page++) {
+		uint32_t address = page << MEMORY_PAGE_SHIFT;
+
+		ctx->MEMORY_ReadMap[page] = pageBase(ctx, address);
+
+		if (ctx->is_multicart && (address >> MEMORY_PAGE_SHIFT) == (0x3000 >> MEMORY_PAGE_SHIFT))
+			ctx->MEMORY_WriteMap[page] = NULL; // bank register
+		else if (address + MEMORY_PAGE_SIZE <= ctx->MEMORY_RAMStart)
+			ctx->MEMORY_WriteMap[page] = ctx->WriteSink; // Protect ROM
+		else if (address < ctx->MEMORY_RAMStart)
+			ctx->MEMORY_WriteMap[page] = NULL;
+		else
+			ctx->MEMORY_WriteMap[page] = ctx->MEMORY_ReadMap[page];
+	}
+}
+
+uint8_t MEMORY_read8_slow(struct channelf *ctx, uint16_t address)
+{
+	uint8_t *ta = translate(ctx, address);
 	return *ta;
 }
 
-void MEMORY_write8(uint16_t address, uint8_t val)
+void MEMORY_write8_slow(struct channelf *ctx, uint16_t address, uint8_t val)
 {
-	if (address == 0x3000 && is_multicart) {
-		MEMORY_Multicart = val;
+	if (address == 0x3000 && ctx->is_multicart) {
+		ctx->MEMORY_Multicart = val;
+		selectBank(ctx);
 		return;
 	}
-	if (address < MEMORY_RAMStart) { // Protect ROM
+	if (address < ctx->MEMORY_RAMStart) { // Protect ROM
 		return;
 	}
-	*translate(address) = val;
+	*translate(ctx, address) = val;
 }
 
-uint16_t MEMORY_read16(uint16_t address)
+uint16_t MEMORY_read16_slow(struct channelf *ctx, uint16_t address)
 {
-	uint8_t *ta = translate(address);
+	uint8_t *ta = translate(ctx, address);
 	return (ta[0]<<8) | ta[1];
 }
 
-void MEMORY_reset(void)
+// Whole pages of RAM are read through the write map, split pages and the
+// bank register page byte by byte. Callers stay at MEMORY_RAMStart and
+// up: ROM pages in the write map point at WriteSink, not the ROM.
+void MEMORY_readRAM(struct channelf *ctx, uint32_t address, uint8_t *buf, uint32_t size)
 {
+	while (size) {
+		uint32_t offset = address & (MEMORY_PAGE_SIZE-1);
+		uint32_t length = MEMORY_PAGE_SIZE - offset;
+		uint8_t *page = ctx->MEMORY_WriteMap[address >> MEMORY_PAGE_SHIFT];
+		uint32_t i;
+		if (length > size)
+			length = size;
+		if (page)
+			memcpy(buf, page + offset, length);
+		else
+			for (i = 0; i < length; i++)
+				buf[i] = *translate(ctx, address + i);
+		address += length;
+		buf += length;
+		size -= length;
+	}
+}
+
+// Whole pages of RAM are written straight through, split pages and the
+// bank register page byte by byte
+void MEMORY_writeRAM(struct channelf *ctx, uint32_t address, const uint8_t *buf, uint32_t size)
+{
+	while (size) {
+		uint32_t offset = address & (MEMORY_PAGE_SIZE-1);
+		uint32_t length = MEMORY_PAGE_SIZE - offset;
+		uint8_t *page = ctx->MEMORY_WriteMap[address >> MEMORY_PAGE_SHIFT];
+		uint32_t i;
+		if (length > size)
+			length = size;
+		if (page) {
+			if (memcmp(page + offset, buf, length)) {
+				memcpy(page + offset, buf, length);
+				ctx->MEMORY_Written[address >> MEMORY_PAGE_SHIFT] = ctx->STATE_Epoch;
+			}
+		} else {
+			for (i = 0; i < length; i++)
+				*translate(ctx, address + i) = buf[i];
+			ctx->MEMORY_Written[address >> MEMORY_PAGE_SHIFT] = ctx->STATE_Epoch;
+		}
+		address += length;
+		buf += length;
+		size -= length;
+	}
+}
+
+void MEMORY_reset(struct channelf *ctx)
+{
+	uint32_t page;
+
 	/* clear memory */
-	memset (Memory + MEMORY_RAMStart, 0, MEMORY_SIZE - MEMORY_RAMStart);
-	MEMORY_Multicart = 0;
+	memset (ctx->Memory + ctx->MEMORY_RAMStart, 0, MEMORY_SIZE - ctx->MEMORY_RAMStart);
+	for (page = 0; page < MEMORY_PAGES; page++)
+		ctx->MEMORY_Written[page] = ctx->STATE_Epoch;
+	ctx->MEMORY_Multicart = 0;
+	MEMORY_remap(ctx);
 }
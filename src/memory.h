@@ -2,6 +2,10 @@
 #define MEMORY_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <retro_inline.h>
+
+#include "channelf.h"
 
 /*
 	This file is part of FreeChaF.
@@ -20,32 +24,47 @@
 	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
 */
 
-extern int MEMORY_RAMStart;
-
-#define MEMORY_SIZE 0x10000
-extern uint8_t Memory[MEMORY_SIZE];
-// sl131253 - 0x000 - 0x3FF
-// sl131254 - 0x400 - 0x7FF
-// cart     - 0x800 - 0x1FFF
-// vram     - 0x2000 ...
-
-void MEMORY_reset(void);
-int MEMORY_loadCartROM(const void* data, size_t size);
-int MEMORY_loadSysROM_libretro(const char* path, int address);
-uint8_t MEMORY_read8(uint16_t address);
-uint16_t MEMORY_read16(uint16_t address);
-void MEMORY_write8(uint16_t address, uint8_t val);
-
-#define R_SIZE 64
-extern uint8_t F8_R[R_SIZE]; // 64 byte Scratchpad
-
-extern uint8_t F8_A; // Accumulator
-extern uint16_t F8_PC0; // Program Counter
-extern uint16_t F8_PC1; // Program Counter alternate
-extern uint16_t F8_DC0; // Data Counter
-extern uint16_t F8_DC1; // Data Counter alternate
-extern uint8_t F8_ISAR; // Indirect Scratchpad Address Register (6-bit)
-extern uint8_t F8_W; // Status Register (flags)
-extern uint8_t MEMORY_Multicart;
+void MEMORY_reset(struct channelf *ctx);
+int MEMORY_loadCartROM(struct channelf *ctx, const void* data, size_t size); // copies data
+int MEMORY_loadCartFile(struct channelf *ctx, const char* path); // maps the file where possible
+void MEMORY_unloadCartROM(struct channelf *ctx);
+int MEMORY_loadSysROM_libretro(struct channelf *ctx, const char* path, int address);
+void MEMORY_remap(struct channelf *ctx); // after MEMORY_RAMStart or MEMORY_Multicart is set directly
+uint8_t MEMORY_read8_slow(struct channelf *ctx, uint16_t address);
+uint16_t MEMORY_read16_slow(struct channelf *ctx, uint16_t address);
+void MEMORY_write8_slow(struct channelf *ctx, uint16_t address, uint8_t val);
+
+// Copy RAM (MEMORY_RAMStart and up) to buf or buf to RAM, for savestates.
+// The multicart bank register is copied as the byte behind it. Writes
+// that change a page count as writes to it, as MEMORY_write8 does.
+void MEMORY_readRAM(struct channelf *ctx, uint32_t address, uint8_t *buf, uint32_t size);
+void MEMORY_writeRAM(struct channelf *ctx, uint32_t address, const uint8_t *buf, uint32_t size);
+
+static INLINE uint8_t MEMORY_read8(struct channelf *ctx, uint16_t address)
+{
+	const uint8_t *page = ctx->MEMORY_ReadMap[address >> MEMORY_PAGE_SHIFT];
+	if (page)
+		return page[address & (MEMORY_PAGE_SIZE-1)];
+	return MEMORY_read8_slow(ctx, address);
+}
+
+static INLINE uint16_t MEMORY_read16(struct channelf *ctx, uint16_t address)
+{
+	const uint8_t *page = ctx->MEMORY_ReadMap[address >> MEMORY_PAGE_SHIFT];
+	const unsigned offset = address & (MEMORY_PAGE_SIZE-1);
+	if (page && offset != MEMORY_PAGE_SIZE-1)
+		return (page[offset]<<8) | page[offset+1];
+	return MEMORY_read16_slow(ctx, address);
+}
+
+static INLINE void MEMORY_write8(struct channelf *ctx, uint16_t address, uint8_t val)
+{
+	uint8_t *page = ctx->MEMORY_WriteMap[address >> MEMORY_PAGE_SHIFT];
+	ctx->MEMORY_Written[address >> MEMORY_PAGE_SHIFT] = ctx->STATE_Epoch;
+	if (page)
+		page[address & (MEMORY_PAGE_SIZE-1)] = val;
+	else
+		MEMORY_write8_slow(ctx, address, val);
+}
 
 #endif
@@ -18,72 +18,87 @@
 #include <string.h>
 #include "osd.h"
 #include "video.h"
+#include "channelf.h"
 
-unsigned int DisplayWidth = 0;
-unsigned int DisplayHeight = 0;
-pixel_t DisplayColor[] = {BLACK, WHITE};
-unsigned int DisplaySize = 0;
-pixel_t *Frame;
+void OSD_setDisplay(struct channelf *ctx, void *frame, enum video_format format, unsigned int width, unsigned int height, unsigned int pitch)
+{
+	ctx->Frame = frame;
+	ctx->DisplayFormat = format;
+	ctx->DisplayWidth = width;
+	ctx->DisplayHeight = height;
+	ctx->DisplayPitch = pitch;
+	ctx->DisplaySize = pitch*height;
+	OSD_setBackground(ctx, BLACK);
+	OSD_setColor(ctx, WHITE);
+}
+
+void OSD_setColor(struct channelf *ctx, uint32_t color)
+{
+	ctx->DisplayColor[1] = VIDEO_mapColor(ctx->DisplayFormat, color);
+}
 
-void OSD_setDisplay(pixel_t frame[], unsigned int width, unsigned int height)
+void OSD_setBackground(struct channelf *ctx, uint32_t color)
 {
-	Frame = frame;
-	DisplayWidth = width;
-	DisplayHeight = height;
-	DisplaySize = width*height;
+	ctx->DisplayColor[0] = VIDEO_mapColor(ctx->DisplayFormat, color);
 }
 
-void OSD_setColor(pixel_t color)
+// Frame pixels are 16 or 32 bits depending on the format
+static uint32_t getPixel(struct channelf *ctx, int offset)
 {
-	DisplayColor[1] = color;
+	if(ctx->DisplayFormat == VIDEO_XRGB8888)
+		return ((uint32_t *)ctx->Frame)[offset];
+	return ((uint16_t *)ctx->Frame)[offset];
 }
 
-void OSD_setBackground(pixel_t color)
+static void putPixel(struct channelf *ctx, int offset, uint32_t color)
 {
-	DisplayColor[0] = color;
+	if(ctx->DisplayFormat == VIDEO_XRGB8888)
+		((uint32_t *)ctx->Frame)[offset] = color;
+	else
+		((uint16_t *)ctx->Frame)[offset] = (uint16_t)color;
 }
 
 // Utility functions
-void OSD_HLine(int x, int y, int len)
+void OSD_HLine(struct channelf *ctx, int x, int y, int len)
 {
-  	int offset = (y*DisplayWidth)+x;
+  	int offset = (y*ctx->DisplayPitch)+x;
 	int i;
 
-	if(x<0 || y<0 || (offset+len)>DisplaySize) { return; }
+	if(x<0 || y<0 || (offset+len)>ctx->DisplaySize) { return; }
 	
 	for(i=0; i<=len; i++)
 	{
-		Frame[offset] = DisplayColor[1];
+		putPixel(ctx, offset, ctx->DisplayColor[1]);
 		offset = offset + 1;
 	}
 }
-void OSD_VLine(int x, int y, int len)
+void OSD_VLine(struct channelf *ctx, int x, int y, int len)
 {
    int offset, i;
-	if(x<0 || y<0 || ((y+len)*DisplayWidth+x)>DisplaySize)
+	if(x<0 || y<0 || ((y+len)*ctx->DisplayPitch+x)>ctx->DisplaySize)
       return;
 	
-	offset = (y*DisplayWidth)+x;
+	offset = (y*ctx->DisplayPitch)+x;
 	for(i=0; i<=len; i++)
 	{
-		Frame[offset] = DisplayColor[1];
-		offset = offset + DisplayWidth;
+		putPixel(ctx, offset, ctx->DisplayColor[1]);
+		offset = offset + ctx->DisplayPitch;
 	}
 }
 
-void OSD_Box(int x1, int y1, int width, int height)
+void OSD_Box(struct channelf *ctx, int x1, int y1, int width, int height)
 {
-	OSD_HLine(x1, y1, width);
-	OSD_HLine(x1, y1+height, width);
-	OSD_VLine(x1, y1, height);
-	OSD_VLine(x1+width, y1, height);
+	OSD_HLine(ctx, x1, y1, width);
+	OSD_HLine(ctx, x1, y1+height, width);
+	OSD_VLine(ctx, x1, y1, height);
+	OSD_VLine(ctx, x1+width, y1, height);
 }
 
-void OSD_FillBox(int x1, int y1, int width, int height)
+void OSD_FillBox(struct channelf *ctx, int x1, int y1, int width, int height)
 {
 	int i;
 	for(i=0; i<height; i++)
-		OSD_HLine(x1, y1+i, width);
+		OSD_HLine(ctx, x1, y1+i, width);
 }
 
 static const int letters[590] = // 32 - 90 59x10
@@ -149,27 +164,27 @@ static const int letters[590] = // 32 - 90 59x10
 	0, 0x7E, 0x04, 0x08, 0x10, 0x20, 0x40, 0x7E, 0, 0  // Z
 };
 
-void OSD_drawLetter(int x, int y, int c)
+void OSD_drawLetter(struct channelf *ctx, int x, int y, int c)
 {
-	unsigned int t = DisplayColor[0];
+	unsigned int t = ctx->DisplayColor[0];
 	int i, j;
-	int offset = (DisplayWidth*y)+x;
+	int offset = (ctx->DisplayPitch*y)+x;
 	c = (c-32) * 10;
 
 	for(i=0; i<10; i++)
 	{
 		for(j=0; j<8; j++)
 		{
-			DisplayColor[0] = Frame[offset+j];
-			Frame[offset+j] = DisplayColor[((letters[c]>>(7-j))&0x01)];
+			ctx->DisplayColor[0] = getPixel(ctx, offset+j);
+			putPixel(ctx, offset+j, ctx->DisplayColor[((letters[c]>>(7-j))&0x01)]);
 		}
-		offset+=DisplayWidth;
+		offset+=ctx->DisplayPitch;
 		c++;
 	}
-	DisplayColor[0] = t;
+	ctx->DisplayColor[0] = t;
 }
 
-void OSD_drawText(int x, int y, const char *text)
+void OSD_drawText(struct channelf *ctx, int x, int y, const char *text)
 {
 	int len = strlen(text);
 	int i   = 0;
@@ -182,112 +197,112 @@ void OSD_drawText(int x, int y, const char *text)
 		if(c>90)
          c = 32;
 		i++;
-		OSD_drawLetter(x, y, c);
+		OSD_drawLetter(ctx, x, y, c);
 		x+=8;
 	}
 }
 
-void OSD_drawTextBoxed(int x, int y, const char *text)
+void OSD_drawTextBoxed(struct channelf *ctx, int x, int y, const char *text)
 {
-	unsigned int t1 = DisplayColor[1];
+	unsigned int t1 = ctx->DisplayColor[1];
 
 	int len         = (strlen(text)*8)+1;
 
-	DisplayColor[1] = DisplayColor[0];
-	OSD_FillBox(x, y, len, 10);
+	ctx->DisplayColor[1] = ctx->DisplayColor[0];
+	OSD_FillBox(ctx, x, y, len, 10);
 
-	DisplayColor[1] = t1;
-	OSD_Box(x, y, len, 10);
+	ctx->DisplayColor[1] = t1;
+	OSD_Box(ctx, x, y, len, 10);
 
-	OSD_drawText(x+1, y+1, text);
+	OSD_drawText(ctx, x+1, y+1, text);
 }
 
-void OSD_drawTextCenterBoxed(int y, const char *text)
+void OSD_drawTextCenterBoxed(struct channelf *ctx, int y, const char *text)
 {
 	int len = (strlen(text)*8)+1;
-	int x = (DisplayWidth-len) / 2;
+	int x = ((int)ctx->DisplayWidth-len) / 2;
 
-	if(x>=0)
-		OSD_drawTextBoxed(x, y, text);
+	if(x>=0) // skip text wider than the display
+		OSD_drawTextBoxed(ctx, x, y, text);
 }
 
 /* ChannelF  */
 
-/* controller swaps */
-void OSD_drawP1P2(void)
+/* controller swaps, in the bottom right corner (the box is 33 pixels wide) */
+void OSD_drawP1P2(struct channelf *ctx)
 {
-	OSD_drawTextBoxed(DisplayWidth-17, DisplayHeight-13, "P2P1");
+	OSD_drawTextBoxed(ctx, ctx->DisplayWidth-36, ctx->DisplayHeight-13, "P2P1");
 }
 
-void OSD_drawP2P1(void)
+void OSD_drawP2P1(struct channelf *ctx)
 {
-	OSD_drawTextBoxed(DisplayWidth-17, DisplayHeight-13, "P1P2");
+	OSD_drawTextBoxed(ctx, ctx->DisplayWidth-36, ctx->DisplayHeight-13, "P1P2");
 }
 
 /* console buttons */
-void OSD_drawConsole(int pos, int down)
+void OSD_drawConsole(struct channelf *ctx, int pos, int down)
 {
 	int i;
-	unsigned int t0 = DisplayColor[0];
-	unsigned int t1 = DisplayColor[1];
+	unsigned int t0 = ctx->DisplayColor[0];
+	unsigned int t1 = ctx->DisplayColor[1];
 
-	int x           = (DisplayWidth-98)/2;
-	int y           = (DisplayHeight-50);
+	int x           = (ctx->DisplayWidth-98)/2;
+	int y           = (ctx->DisplayHeight-50);
 
-	DisplayColor[1] = BLACK;
-	OSD_FillBox(x, y, 98, 21);
-	DisplayColor[1] = WHITE;
-	OSD_Box(x, y, 98, 21);
+	OSD_setColor(ctx, BLACK);
+	OSD_FillBox(ctx, x, y, 98, 21);
+	OSD_setColor(ctx, WHITE);
+	OSD_Box(ctx, x, y, 98, 21);
 
 	x += 3;
 	y += 3;
-	DisplayColor[1] = YELLOW;
-	OSD_FillBox(x, y, 16, 16);
-	DisplayColor[1] = BLACK;
-	OSD_drawLetter(x+4, y+4, 'R');
+	OSD_setColor(ctx, YELLOW);
+	OSD_FillBox(ctx, x, y, 16, 16);
+	OSD_setColor(ctx, BLACK);
+	OSD_drawLetter(ctx, x+4, y+4, 'R');
 	
 	for(i=0; i<4; i++)
 	{
 		x+=19;
-		DisplayColor[1] = GRAY_CC;
-		OSD_FillBox(x, y, 16, 16);
-		DisplayColor[1] = BLACK;
-		OSD_drawLetter(x+4, y+4, 48+(i+1));
+		OSD_setColor(ctx, GRAY_CC);
+		OSD_FillBox(ctx, x, y, 16, 16);
+		OSD_setColor(ctx, BLACK);
+		OSD_drawLetter(ctx, x+4, y+4, 48+(i+1));
 	}
 	
 	// draw cursor
 	x = x-76;
-	DisplayColor[1] = GREEN;
-	OSD_Box(x+(19*pos)-1, y-1, 17, 17);
+	OSD_setColor(ctx, GREEN);
+	OSD_Box(ctx, x+(19*pos)-1, y-1, 17, 17);
 	if(down)
-		OSD_Box(x+(19*pos), y, 15, 15);
+		OSD_Box(ctx, x+(19*pos), y, 15, 15);
 
-	DisplayColor[0] = BLACK;
-	DisplayColor[1] = WHITE;
+	OSD_setBackground(ctx, BLACK);
+	OSD_setColor(ctx, WHITE);
 
 	switch(pos)
    {
       case 0:
-         OSD_drawTextCenterBoxed(DisplayHeight-26, "RESET");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-26, "RESET");
          break;
       case 1:
-         OSD_drawTextCenterBoxed(DisplayHeight-26, "TIME");
-         OSD_drawTextCenterBoxed(DisplayHeight-16, "2 MIN / HOCKEY");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-26, "TIME");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-16, "2 MIN / HOCKEY");
          break;
       case 2:
-         OSD_drawTextCenterBoxed(DisplayHeight-26, "MODE");
-         OSD_drawTextCenterBoxed(DisplayHeight-16, "5 MIN / TENNIS");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-26, "MODE");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-16, "5 MIN / TENNIS");
          break;
       case 3:
-         OSD_drawTextCenterBoxed(DisplayHeight-26, "HOLD");
-         OSD_drawTextCenterBoxed(DisplayHeight-16, "10 MIN / GAME 3");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-26, "HOLD");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-16, "10 MIN / GAME 3");
          break;
       case 4:
-         OSD_drawTextCenterBoxed(DisplayHeight-26, "START");
-         OSD_drawTextCenterBoxed(DisplayHeight-16, "20 MIN / GAME 4");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-26, "START");
+         OSD_drawTextCenterBoxed(ctx, ctx->DisplayHeight-16, "20 MIN / GAME 4");
          break;
    }
 
-	DisplayColor[0] = t0;
-	DisplayColor[1] = t1;
+	ctx->DisplayColor[0] = t0;
+	ctx->DisplayColor[1] = t1;
 }
@@ -20,34 +20,39 @@
 // On-Screen Display //
 #include "video.h"
 
-void OSD_setDisplay(pixel_t frame[], unsigned int width, unsigned int height);
+struct channelf;
 
-void OSD_setColor(pixel_t color);
+// Draw into frame, pixels in format, pitch in pixels. Resets the colors
+// to white on black.
+void OSD_setDisplay(struct channelf *ctx, void *frame, enum video_format format, unsigned int width, unsigned int height, unsigned int pitch);
 
-void OSD_setBackground(pixel_t color);
+// colors as 0xRRGGBB
+void OSD_setColor(struct channelf *ctx, uint32_t color);
 
-void OSD_HLine(int x, int y, int len);
+void OSD_setBackground(struct channelf *ctx, uint32_t color);
 
-void OSD_VLine(int x, int y, int len);
+void OSD_HLine(struct channelf *ctx, int x, int y, int len);
 
-void OSD_Box(int x1, int y1, int width, int height);
+void OSD_VLine(struct channelf *ctx, int x, int y, int len);
 
-void OSD_FillBox(int x1, int y1, int width, int height);
+void OSD_Box(struct channelf *ctx, int x1, int y1, int width, int height);
 
-void OSD_drawLetter(int x, int y, int c);
+void OSD_FillBox(struct channelf *ctx, int x1, int y1, int width, int height);
 
-void OSD_drawText(int x, int y, const char *text);
+void OSD_drawLetter(struct channelf *ctx, int x, int y, int c);
 
-void OSD_drawTextBoxed(int x, int y, const char *text);
+void OSD_drawText(struct channelf *ctx, int x, int y, const char *text);
 
-void OSD_drawTextCenterBoxed(int y, const char *text);
+void OSD_drawTextBoxed(struct channelf *ctx, int x, int y, const char *text);
 
-void OSD_drawPaused(void);
+void OSD_drawTextCenterBoxed(struct channelf *ctx, int y, const char *text);
 
-void OSD_drawP1P2(void);
+void OSD_drawPaused(struct channelf *ctx);
 
-void OSD_drawP2P1(void);
+void OSD_drawP1P2(struct channelf *ctx);
 
-void OSD_drawConsole(int pos, int down);
+void OSD_drawP2P1(struct channelf *ctx);
+
+void OSD_drawConsole(struct channelf *ctx, int pos, int down);
 
 #endif
@@ -18,36 +18,35 @@
 #include <string.h>
 
 #include "ports.h"
+#include "channelf.h"
 #include "f2102.h"
 #include "audio.h"
 #include "video.h"
 #include "controller.h"
 
-uint8_t Ports[64];
-
 // Read state of port
-uint8_t PORTS_read(uint8_t port)
+uint8_t PORTS_read(struct channelf *ctx, uint8_t port)
 {
-	return Ports[port] | CONTROLLER_portRead(port); // controllers don't latch?
+	return ctx->Ports[port] | CONTROLLER_portRead(ctx, port); // controllers don't latch?
 }
 
 // Write data to port
-void PORTS_write(uint8_t port, uint8_t val)
+void PORTS_write(struct channelf *ctx, uint8_t port, uint8_t val)
 {
-	Ports[port] = val;
+	ctx->Ports[port] = val;
 }
 
-void PORTS_notify(uint8_t port, uint8_t val)
+void PORTS_notify(struct channelf *ctx, uint8_t port, uint8_t val)
 {
-	Ports[port] = val;
+	ctx->Ports[port] = val;
 
-	F2102_portReceive(port, val);
-	AUDIO_portReceive(port, val);
-	VIDEO_portReceive(port, val);
-	CONTROLLER_portReceive(port, val);
+	F2102_portReceive(ctx, port, val);
+	AUDIO_portReceive(ctx, port, val);
+	VIDEO_portReceive(ctx, port, val);
+	CONTROLLER_portReceive(ctx, port, val);
 }
 
-void PORTS_reset(void)
+void PORTS_reset(struct channelf *ctx)
 {
-	memset(Ports, 0, sizeof(Ports));
+	memset(ctx->Ports, 0, sizeof(ctx->Ports));
 }
@@ -20,15 +20,15 @@
 	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
 */
 
-// IO Ports 
-extern uint8_t Ports[64];
+struct channelf;
 
-uint8_t PORTS_read(uint8_t port);
+// IO Ports 
+uint8_t PORTS_read(struct channelf *ctx, uint8_t port);
 
-void PORTS_write(uint8_t port, uint8_t val);
+void PORTS_write(struct channelf *ctx, uint8_t port, uint8_t val);
 
-void PORTS_notify(uint8_t port, uint8_t val);
+void PORTS_notify(struct channelf *ctx, uint8_t port, uint8_t val);
 
-void PORTS_reset(void);
+void PORTS_reset(struct channelf *ctx);
 
 #endif
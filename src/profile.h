@@ -0,0 +1,69 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+/*
+	This file is part of FreeChaF.
+
+	FreeChaF is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	FreeChaF is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
+*/
+
+// Host time spent in each part of a frame, for the benchmark driver.
+// Only collected when built with FREECHAF_PROFILE (make bench), the
+// macros compile to nothing otherwise. The counters are global, so a
+// profiled build should run a single machine.
+
+enum profile_section
+{
+	PROFILE_CPU,     // F8_run / F8_exec / HLE calls
+	PROFILE_AUDIO,   // AUDIO_frame
+	PROFILE_VIDEO,   // VIDEO_drawFrame, palette conversion and 3x upscale
+	PROFILE_OSD,     // on-screen display
+	PROFILE_STATE,   // savestates, rewind snapshots and steps
+	PROFILE_SECTIONS
+};
+
+#ifdef FREECHAF_PROFILE
+
+#include <stdint.h>
+#include <time.h>
+#include <retro_inline.h>
+
+struct profile
+{
+	uint64_t ns[PROFILE_SECTIONS];
+	uint64_t start[PROFILE_SECTIONS];
+	uint64_t instructions; // F8 instructions executed, including skipped loop iterations
+};
+
+extern struct profile Profile;
+
+static INLINE uint64_t PROFILE_now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+#define PROFILE_BEGIN(section) (Profile.start[section] = PROFILE_now())
+#define PROFILE_END(section) (Profile.ns[section] += PROFILE_now() - Profile.start[section])
+#define PROFILE_COUNT(n) (Profile.instructions += (n))
+
+#else
+
+#define PROFILE_BEGIN(section) ((void)0)
+#define PROFILE_END(section) ((void)0)
+#define PROFILE_COUNT(n) ((void)0)
+
+#endif
+
+#endif
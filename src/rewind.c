@@ -0,0 +1,293 @@
+/*
+	This file is part of FreeChaF.
+
+	FreeChaF is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	FreeChaF is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rewind.h"
+#include "state.h"
+
+#define MIN_RUN 4 // equal bytes that end a run of changed ones
+
+struct rewind
+{
+	// Deltas, oldest at tail. Each is its length, the encoded XOR and the
+	// length again, so the ring can be walked from both ends. Reads and
+	// writes wrap at capacity.
+	uint8_t *ring;
+	size_t capacity;
+	size_t head; // where the next delta goes
+	size_t tail; // oldest delta
+	size_t used;
+	unsigned int frames;
+
+	size_t stateSize; // 0 until the first push
+	uint8_t *current; // state of the last frame pushed
+	uint8_t *next; // state being pushed, over the one before current
+	uint8_t *delta; // encoding of current ^ next
+	uint32_t currentMark; // STATE_saveDirty marks of current and next
+	uint32_t nextMark;
+};
+
+struct rewind *REWIND_create(size_t capacity)
+{
+	struct rewind *rw = (struct rewind *)calloc(1, sizeof(*rw));
+
+	if(!rw)
+	{
+		return NULL;
+	}
+	rw->ring = (uint8_t *)malloc(capacity);
+	if(!rw->ring)
+	{
+		free(rw);
+		return NULL;
+	}
+	rw->capacity = capacity;
+	return rw;
+}
+
+void REWIND_destroy(struct rewind *rw)
+{
+	if(!rw)
+	{
+		return;
+	}
+	free(rw->ring);
+	free(rw->current);
+	free(rw->next);
+	free(rw->delta);
+	free(rw);
+}
+
+void REWIND_clear(struct rewind *rw)
+{
+	rw->head = 0;
+	rw->tail = 0;
+	rw->used = 0;
+	rw->frames = 0;
+	rw->stateSize = 0;
+}
+
+unsigned int REWIND_frames(const struct rewind *rw)
+{
+	return rw->frames;
+}
+
+static void ringWrite(struct rewind *rw, size_t pos, const uint8_t *data, size_t size)
+{
+	size_t first = rw->capacity - pos;
+
+	if(first >= size)
+	{
+		memcpy(rw->ring + pos, data, size);
+		return;
+	}
+	memcpy(rw->ring + pos, data, first);
+	memcpy(rw->ring, data + first, size - first);
+}
+
+static void ringRead(const struct rewind *rw, size_t pos, uint8_t *data, size_t size)
+{
+	size_t first = rw->capacity - pos;
+
+	if(first >= size)
+	{
+		memcpy(data, rw->ring + pos, size);
+		return;
+	}
+	memcpy(data, rw->ring + pos, first);
+	memcpy(data + first, rw->ring, size - first);
+}
+
+static size_t ringLength(const struct rewind *rw, size_t pos)
+{
+	uint8_t length[4];
+
+	ringRead(rw, pos % rw->capacity, length, 4);
+	return ((size_t)length[0] << 24) | (length[1] << 16) | (length[2] << 8) | length[3];
+}
+
+static uint8_t *putCount(uint8_t *p, size_t count)
+{
+	while(count >= 0x80)
+	{
+		*p++ = 0x80 | (count & 0x7F);
+		count >>= 7;
+	}
+	*p++ = count;
+	return p;
+}
+
+static const uint8_t *getCount(const uint8_t *p, size_t *count)
+{
+	unsigned int shift = 0;
+
+	*count = 0;
+	do
+	{
+		*count |= (size_t)(*p & 0x7F) << shift;
+		shift += 7;
+	} while(*p++ & 0x80);
+	return p;
+}
+
+// Encode a ^ b as pairs of counts, equal bytes to skip and changed bytes
+// to follow, each followed by the changed bytes XORed
+static size_t encode(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t size)
+{
+	uint8_t *p = out;
+	size_t i = 0;
+
+	while(i < size)
+	{
+		size_t start = i;
+		size_t changed;
+
+		// most of a state is unchanged, skip it a word at a time
+		while(i + 8 <= size && !memcmp(a + i, b + i, 8))
+			i += 8;
+		while(i < size && a[i] == b[i])
+			i++;
+		p = putCount(p, i - start);
+
+		start = i;
+		while(i < size && !(i + MIN_RUN <= size && !memcmp(a + i, b + i, MIN_RUN)))
+			i++;
+		p = putCount(p, i - start);
+		for(changed = start; changed < i; changed++)
+			*p++ = a[changed] ^ b[changed];
+	}
+	return p - out;
+}
+
+static void apply(uint8_t *state, const uint8_t *delta, size_t size)
+{
+	const uint8_t *end = delta + size;
+	size_t pos = 0;
+	size_t count;
+
+	while(delta < end)
+	{
+		delta = getCount(delta, &count);
+		pos += count;
+		delta = getCount(delta, &count);
+		while(count--)
+			state[pos++] ^= *delta++;
+	}
+}
+
+int REWIND_push(struct rewind *rw, struct channelf *ctx)
+{
+	size_t size = STATE_size(ctx);
+	size_t length;
+	uint8_t *swap;
+	uint32_t mark;
+
+	if(size != rw->stateSize) // first push, or another cart
+	{
+		REWIND_clear(rw);
+		free(rw->current);
+		free(rw->next);
+		free(rw->delta);
+		rw->current = (uint8_t *)malloc(size);
+		rw->next = (uint8_t *)malloc(size);
+		rw->delta = (uint8_t *)malloc(size + size / MIN_RUN + 16); // an unchanged run every MIN_RUN bytes at worst
+		if(!rw->current || !rw->next || !rw->delta)
+		{
+			return 0;
+		}
+		rw->currentMark = 0;
+		rw->nextMark = 0;
+		STATE_saveDirty(ctx, NULL, rw->current, size, &rw->currentMark);
+		rw->stateSize = size;
+		return 1;
+	}
+
+	// next is two frames old, only what changed since is copied
+	STATE_saveDirty(ctx, NULL, rw->next, size, &rw->nextMark);
+	length = encode(rw->delta, rw->current, rw->next, size);
+	swap = rw->current;
+	rw->current = rw->next;
+	rw->next = swap;
+	mark = rw->currentMark;
+	rw->currentMark = rw->nextMark;
+	rw->nextMark = mark;
+
+	if(length + 8 > rw->capacity) // can't hold even this frame
+	{
+		rw->head = rw->tail = rw->used = 0;
+		rw->frames = 0;
+		return 1;
+	}
+
+	// make room by dropping the oldest frames
+	while(rw->capacity - rw->used < length + 8)
+	{
+		size_t oldest = ringLength(rw, rw->tail) + 8;
+
+		rw->tail = (rw->tail + oldest) % rw->capacity;
+		rw->used -= oldest;
+		rw->frames--;
+	}
+
+	{
+		uint8_t header[4];
+
+		header[0] = length >> 24;
+		header[1] = length >> 16;
+		header[2] = length >> 8;
+		header[3] = length;
+		ringWrite(rw, rw->head, header, 4);
+		ringWrite(rw, (rw->head + 4) % rw->capacity, rw->delta, length);
+		ringWrite(rw, (rw->head + 4 + length) % rw->capacity, header, 4);
+	}
+	rw->head = (rw->head + length + 8) % rw->capacity;
+	rw->used += length + 8;
+	rw->frames++;
+	return 1;
+}
+
+int REWIND_step(struct rewind *rw, struct channelf *ctx)
+{
+	size_t length;
+	size_t start;
+
+	if(!rw->frames || rw->stateSize != STATE_size(ctx))
+	{
+		return 0;
+	}
+
+	length = ringLength(rw, rw->head + rw->capacity - 4);
+	start = (rw->head + rw->capacity - 4 - length) % rw->capacity;
+	ringRead(rw, start, rw->delta, length);
+	apply(rw->current, rw->delta, length);
+
+	rw->head = (start + rw->capacity - 4) % rw->capacity;
+	rw->used -= length + 8;
+	rw->frames--;
+
+	if(!STATE_load(ctx, NULL, rw->current, rw->stateSize))
+	{
+		return 0;
+	}
+	// current holds an older frame than its mark, and next is further
+	// away than before, both are saved in full when they come round
+	rw->currentMark = 0;
+	rw->nextMark = 0;
+	return 1;
+}
@@ -0,0 +1,49 @@
+#ifndef REWIND_H
+#define REWIND_H
+/*
+	This file is part of FreeChaF.
+
+	FreeChaF is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	FreeChaF is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <stddef.h>
+
+struct channelf;
+
+// In-core rewind. The state of the last frame pushed is kept whole and
+// every frame before it as the XOR of its state with the next one, with
+// runs of zeros (unchanged bytes) left out. Most frames change a few
+// dozen bytes, so a 1MB buffer holds several minutes. The oldest frames
+// are dropped when the buffer is full.
+struct rewind;
+
+// A rewind buffer of capacity bytes for the deltas, NULL if out of memory
+struct rewind *REWIND_create(size_t capacity);
+
+void REWIND_destroy(struct rewind *rw);
+
+// Forget every frame, for after a reset or a state is loaded
+void REWIND_clear(struct rewind *rw);
+
+// Record the machine at the end of a frame. Returns 0 if out of memory.
+int REWIND_push(struct rewind *rw, struct channelf *ctx);
+
+// Put the machine back one frame. Returns 0, leaving the machine alone,
+// when no earlier frame is left.
+int REWIND_step(struct rewind *rw, struct channelf *ctx);
+
+// Frames REWIND_step can go back
+unsigned int REWIND_frames(const struct rewind *rw);
+
+#endif
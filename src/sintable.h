@@ -1,242 +0,0 @@
-/*
-	This file is part of FreeChaF.
-
-	FreeChaF is free software: you can redistribute it and/or modify
-	it under the terms of the GNU General Public License as published by
-	the Free Software Foundation, either version 3 of the License, or
-	(at your option) any later version.
-
-	FreeChaF is distributed in the hope that it will be useful,
-	but WITHOUT ANY WARRANTY; without even the implied warranty of
-	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-	GNU General Public License for more details.
-
-	You should have received a copy of the GNU General Public License
-	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
-*/
-
-#define SINSAMPLES 2205
-// 20 Hz tone sampled at 44100 Hz
-static int sintable[SINSAMPLES] = {
-0,  93, 186, 280, 373, 466, 560, 653, 746, 840, 933, 
-1026, 1120, 1213, 1306, 1400, 1493, 1586, 1679, 1773, 1866, 
-1959, 2052, 2145, 2239, 2332, 2425, 2518, 2611, 2704, 2797, 
-2890, 2983, 3076, 3169, 3262, 3355, 3448, 3541, 3633, 3726, 
-3819, 3912, 4004, 4097, 4190, 4282, 4375, 4467, 4560, 4652, 
-4745, 4837, 4929, 5022, 5114, 5206, 5298, 5390, 5482, 5574, 
-5666, 5758, 5850, 5942, 6034, 6126, 6217, 6309, 6401, 6492, 
-6584, 6675, 6766, 6858, 6949, 7040, 7131, 7223, 7314, 7405, 
-7496, 7586, 7677, 7768, 7859, 7949, 8040, 8130, 8221, 8311, 
-8401, 8491, 8582, 8672, 8762, 8852, 8942, 9031, 9121, 9211, 
-9300, 9390, 9479, 9568, 9658, 9747, 9836, 9925, 10014, 10103, 
-10192, 10280, 10369, 10457, 10546, 10634, 10723, 10811, 10899, 10987, 
-11075, 11163, 11250, 11338, 11426, 11513, 11600, 11688, 11775, 11862, 
-11949, 12036, 12123, 12209, 12296, 12382, 12469, 12555, 12641, 12727, 
-12813, 12899, 12985, 13071, 13156, 13242, 13327, 13412, 13497, 13582, 
-13667, 13752, 13837, 13921, 14006, 14090, 14174, 14259, 14343, 14427, 
-14510, 14594, 14677, 14761, 14844, 14927, 15010, 15093, 15176, 15259, 
-15341, 15424, 15506, 15588, 15670, 15752, 15834, 15916, 15997, 16079, 
-16160, 16241, 16322, 16403, 16484, 16565, 16645, 16725, 16806, 16886, 
-16966, 17046, 17125, 17205, 17284, 17363, 17442, 17521, 17600, 17679, 
-17758, 17836, 17914, 17992, 18070, 18148, 18226, 18303, 18381, 18458, 
-18535, 18612, 18689, 18765, 18842, 18918, 18994, 19070, 19146, 19222, 
-19297, 19373, 19448, 19523, 19598, 19673, 19747, 19822, 19896, 19970, 
-20044, 20118, 20191, 20265, 20338, 20411, 20484, 20557, 20630, 20702, 
-20774, 20846, 20918, 20990, 21062, 21133, 21204, 21276, 21346, 21417, 
-21488, 21558, 21628, 21698, 21768, 21838, 21908, 21977, 22046, 22115, 
-22184, 22252, 22321, 22389, 22457, 22525, 22593, 22660, 22728, 22795, 
-22862, 22929, 22995, 23062, 23128, 23194, 23260, 23326, 23391, 23456, 
-23521, 23586, 23651, 23716, 23780, 23844, 23908, 23972, 24035, 24099, 
-24162, 24225, 24288, 24350, 24413, 24475, 24537, 24598, 24660, 24721, 
-24783, 24844, 24904, 24965, 25025, 25085, 25145, 25205, 25265, 25324, 
-25383, 25442, 25501, 25559, 25618, 25676, 25734, 25791, 25849, 25906, 
-25963, 26020, 26077, 26133, 26189, 26245, 26301, 26357, 26412, 26467, 
-26522, 26577, 26631, 26686, 26740, 26794, 26847, 26901, 26954, 27007, 
-27060, 27112, 27165, 27217, 27269, 27320, 27372, 27423, 27474, 27525, 
-27575, 27625, 27676, 27725, 27775, 27825, 27874, 27923, 27971, 28020, 
-28068, 28116, 28164, 28212, 28259, 28306, 28353, 28400, 28446, 28493, 
-28539, 28584, 28630, 28675, 28720, 28765, 28810, 28854, 28898, 28942, 
-28986, 29029, 29072, 29115, 29158, 29200, 29243, 29285, 29326, 29368, 
-29409, 29450, 29491, 29532, 29572, 29612, 29652, 29692, 29731, 29770, 
-29809, 29848, 29886, 29924, 29962, 30000, 30037, 30074, 30111, 30148, 
-30184, 30221, 30257, 30292, 30328, 30363, 30398, 30433, 30467, 30501, 
-30535, 30569, 30603, 30636, 30669, 30702, 30734, 30766, 30798, 30830, 
-30862, 30893, 30924, 30955, 30985, 31015, 31045, 31075, 31105, 31134, 
-31163, 31191, 31220, 31248, 31276, 31304, 31331, 31359, 31385, 31412, 
-31439, 31465, 31491, 31516, 31542, 31567, 31592, 31617, 31641, 31665, 
-31689, 31713, 31736, 31759, 31782, 31804, 31827, 31849, 31871, 31892, 
-31914, 31935, 31955, 31976, 31996, 32016, 32036, 32055, 32075, 32093, 
-32112, 32131, 32149, 32167, 32184, 32202, 32219, 32236, 32252, 32269, 
-32285, 32301, 32316, 32331, 32346, 32361, 32376, 32390, 32404, 32418, 
-32431, 32444, 32457, 32470, 32482, 32494, 32506, 32518, 32529, 32540, 
-32551, 32562, 32572, 32582, 32592, 32601, 32611, 32620, 32628, 32637, 
-32645, 32653, 32660, 32668, 32675, 32682, 32688, 32695, 32701, 32706, 
-32712, 32717, 32722, 32727, 32731, 32736, 32739, 32743, 32747, 32750, 
-32753, 32755, 32757, 32760, 32761, 32763, 32764, 32765, 32766, 32766, 
-32766, 32766, 32766, 32765, 32765, 32763, 32762, 32760, 32759, 32756, 
-32754, 32751, 32748, 32745, 32741, 32738, 32734, 32729, 32725, 32720, 
-32715, 32709, 32704, 32698, 32691, 32685, 32678, 32671, 32664, 32657, 
-32649, 32641, 32632, 32624, 32615, 32606, 32597, 32587, 32577, 32567, 
-32557, 32546, 32535, 32524, 32512, 32500, 32488, 32476, 32464, 32451, 
-32438, 32424, 32411, 32397, 32383, 32369, 32354, 32339, 32324, 32308, 
-32293, 32277, 32261, 32244, 32227, 32210, 32193, 32176, 32158, 32140, 
-32121, 32103, 32084, 32065, 32046, 32026, 32006, 31986, 31966, 31945, 
-31924, 31903, 31881, 31860, 31838, 31816, 31793, 31770, 31747, 31724, 
-31701, 31677, 31653, 31629, 31604, 31579, 31554, 31529, 31504, 31478, 
-31452, 31425, 31399, 31372, 31345, 31318, 31290, 31262, 31234, 31206, 
-31177, 31148, 31119, 31090, 31060, 31030, 31000, 30970, 30939, 30908, 
-30877, 30846, 30814, 30782, 30750, 30718, 30685, 30652, 30619, 30586, 
-30552, 30518, 30484, 30450, 30415, 30381, 30345, 30310, 30274, 30239, 
-30203, 30166, 30130, 30093, 30056, 30018, 29981, 29943, 29905, 29867, 
-29828, 29790, 29751, 29711, 29672, 29632, 29592, 29552, 29511, 29471, 
-29430, 29389, 29347, 29306, 29264, 29222, 29179, 29137, 29094, 29051, 
-29007, 28964, 28920, 28876, 28832, 28787, 28743, 28698, 28653, 28607, 
-28561, 28516, 28469, 28423, 28377, 28330, 28283, 28235, 28188, 28140, 
-28092, 28044, 27996, 27947, 27898, 27849, 27800, 27750, 27701, 27651, 
-27600, 27550, 27499, 27448, 27397, 27346, 27294, 27243, 27191, 27138, 
-27086, 27033, 26980, 26927, 26874, 26821, 26767, 26713, 26659, 26604, 
-26550, 26495, 26440, 26385, 26329, 26273, 26217, 26161, 26105, 26049, 
-25992, 25935, 25878, 25820, 25763, 25705, 25647, 25589, 25530, 25472, 
-25413, 25354, 25294, 25235, 25175, 25115, 25055, 24995, 24935, 24874, 
-24813, 24752, 24691, 24629, 24568, 24506, 24444, 24381, 24319, 24256, 
-24193, 24130, 24067, 24004, 23940, 23876, 23812, 23748, 23683, 23619, 
-23554, 23489, 23424, 23358, 23293, 23227, 23161, 23095, 23029, 22962, 
-22895, 22828, 22761, 22694, 22627, 22559, 22491, 22423, 22355, 22287, 
-22218, 22149, 22081, 22011, 21942, 21873, 21803, 21733, 21663, 21593, 
-21523, 21453, 21382, 21311, 21240, 21169, 21097, 21026, 20954, 20882, 
-20810, 20738, 20666, 20593, 20521, 20448, 20375, 20301, 20228, 20154, 
-20081, 20007, 19933, 19859, 19784, 19710, 19635, 19560, 19485, 19410, 
-19335, 19259, 19184, 19108, 19032, 18956, 18880, 18803, 18727, 18650, 
-18573, 18496, 18419, 18342, 18264, 18187, 18109, 18031, 17953, 17875, 
-17797, 17718, 17640, 17561, 17482, 17403, 17324, 17244, 17165, 17085, 
-17006, 16926, 16846, 16766, 16685, 16605, 16524, 16444, 16363, 16282, 
-16201, 16120, 16038, 15957, 15875, 15793, 15711, 15629, 15547, 15465, 
-15383, 15300, 15218, 15135, 15052, 14969, 14886, 14803, 14719, 14636, 
-14552, 14468, 14385, 14301, 14217, 14132, 14048, 13964, 13879, 13795, 
-13710, 13625, 13540, 13455, 13370, 13284, 13199, 13113, 13028, 12942, 
-12856, 12770, 12684, 12598, 12512, 12426, 12339, 12253, 12166, 12079, 
-11992, 11905, 11818, 11731, 11644, 11557, 11469, 11382, 11294, 11206, 
-11119, 11031, 10943, 10855, 10767, 10678, 10590, 10502, 10413, 10325, 
-10236, 10147, 10058, 9970, 9881, 9791, 9702, 9613, 9524, 9434, 
-9345, 9255, 9166, 9076, 8986, 8897, 8807, 8717, 8627, 8537, 
-8446, 8356, 8266, 8175, 8085, 7994, 7904, 7813, 7723, 7632, 
-7541, 7450, 7359, 7268, 7177, 7086, 6995, 6903, 6812, 6721, 
-6629, 6538, 6446, 6355, 6263, 6172, 6080, 5988, 5896, 5804, 
-5712, 5620, 5528, 5436, 5344, 5252, 5160, 5068, 4975, 4883, 
-4791, 4698, 4606, 4514, 4421, 4329, 4236, 4143, 4051, 3958, 
-3865, 3773, 3680, 3587, 3494, 3401, 3308, 3216, 3123, 3030, 
-2937, 2844, 2751, 2658, 2565, 2471, 2378, 2285, 2192, 2099, 
-2006, 1912, 1819, 1726, 1633, 1540, 1446, 1353, 1260, 1166, 
-1073, 980, 886, 793, 700, 606, 513, 420, 326, 233, 
-140, 46, -46, -140, -233, -326, -420, -513, -606, -700, 
--793, -886, -980, -1073, -1166, -1260, -1353, -1446, -1540, -1633, 
--1726, -1819, -1912, -2006, -2099, -2192, -2285, -2378, -2471, -2565, 
--2658, -2751, -2844, -2937, -3030, -3123, -3216, -3308, -3401, -3494, 
--3587, -3680, -3773, -3865, -3958, -4051, -4143, -4236, -4329, -4421, 
--4514, -4606, -4698, -4791, -4883, -4975, -5068, -5160, -5252, -5344, 
--5436, -5528, -5620, -5712, -5804, -5896, -5988, -6080, -6172, -6263, 
--6355, -6446, -6538, -6629, -6721, -6812, -6903, -6995, -7086, -7177, 
--7268, -7359, -7450, -7541, -7632, -7723, -7813, -7904, -7994, -8085, 
--8175, -8266, -8356, -8446, -8537, -8627, -8717, -8807, -8897, -8986, 
--9076, -9166, -9255, -9345, -9434, -9524, -9613, -9702, -9791, -9881, 
--9970, -10058, -10147, -10236, -10325, -10413, -10502, -10590, -10678, -10767, 
--10855, -10943, -11031, -11119, -11206, -11294, -11382, -11469, -11557, -11644, 
--11731, -11818, -11905, -11992, -12079, -12166, -12253, -12339, -12426, -12512, 
--12598, -12684, -12770, -12856, -12942, -13028, -13113, -13199, -13284, -13370, 
--13455, -13540, -13625, -13710, -13795, -13879, -13964, -14048, -14132, -14217, 
--14301, -14385, -14468, -14552, -14636, -14719, -14803, -14886, -14969, -15052, 
--15135, -15218, -15300, -15383, -15465, -15547, -15629, -15711, -15793, -15875, 
--15957, -16038, -16120, -16201, -16282, -16363, -16444, -16524, -16605, -16685, 
--16766, -16846, -16926, -17006, -17085, -17165, -17244, -17324, -17403, -17482, 
--17561, -17640, -17718, -17797, -17875, -17953, -18031, -18109, -18187, -18264, 
--18342, -18419, -18496, -18573, -18650, -18727, -18803, -18880, -18956, -19032, 
--19108, -19184, -19259, -19335, -19410, -19485, -19560, -19635, -19710, -19784, 
--19859, -19933, -20007, -20081, -20154, -20228, -20301, -20375, -20448, -20521, 
--20593, -20666, -20738, -20810, -20882, -20954, -21026, -21097, -21169, -21240, 
--21311, -21382, -21453, -21523, -21593, -21663, -21733, -21803, -21873, -21942, 
--22011, -22081, -22149, -22218, -22287, -22355, -22423, -22491, -22559, -22627, 
--22694, -22761, -22828, -22895, -22962, -23029, -23095, -23161, -23227, -23293, 
--23358, -23424, -23489, -23554, -23619, -23683, -23748, -23812, -23876, -23940, 
--24004, -24067, -24130, -24193, -24256, -24319, -24381, -24444, -24506, -24568, 
--24629, -24691, -24752, -24813, -24874, -24935, -24995, -25055, -25115, -25175, 
--25235, -25294, -25354, -25413, -25472, -25530, -25589, -25647, -25705, -25763, 
--25820, -25878, -25935, -25992, -26049, -26105, -26161, -26217, -26273, -26329, 
--26385, -26440, -26495, -26550, -26604, -26659, -26713, -26767, -26821, -26874, 
--26927, -26980, -27033, -27086, -27138, -27191, -27243, -27294, -27346, -27397, 
--27448, -27499, -27550, -27600, -27651, -27701, -27750, -27800, -27849, -27898, 
--27947, -27996, -28044, -28092, -28140, -28188, -28235, -28283, -28330, -28377, 
--28423, -28469, -28516, -28561, -28607, -28653, -28698, -28743, -28787, -28832, 
--28876, -28920, -28964, -29007, -29051, -29094, -29137, -29179, -29222, -29264, 
--29306, -29347, -29389, -29430, -29471, -29511, -29552, -29592, -29632, -29672, 
--29711, -29751, -29790, -29828, -29867, -29905, -29943, -29981, -30018, -30056, 
--30093, -30130, -30166, -30203, -30239, -30274, -30310, -30345, -30381, -30415, 
--30450, -30484, -30518, -30552, -30586, -30619, -30652, -30685, -30718, -30750, 
--30782, -30814, -30846, -30877, -30908, -30939, -30970, -31000, -31030, -31060, 
--31090, -31119, -31148, -31177, -31206, -31234, -31262, -31290, -31318, -31345, 
--31372, -31399, -31425, -31452, -31478, -31504, -31529, -31554, -31579, -31604, 
--31629, -31653, -31677, -31701, -31724, -31747, -31770, -31793, -31816, -31838, 
--31860, -31881, -31903, -31924, -31945, -31966, -31986, -32006, -32026, -32046, 
--32065, -32084, -32103, -32121, -32140, -32158, -32176, -32193, -32210, -32227, 
--32244, -32261, -32277, -32293, -32308, -32324, -32339, -32354, -32369, -32383, 
--32397, -32411, -32424, -32438, -32451, -32464, -32476, -32488, -32500, -32512, 
--32524, -32535, -32546, -32557, -32567, -32577, -32587, -32597, -32606, -32615, 
--32624, -32632, -32641, -32649, -32657, -32664, -32671, -32678, -32685, -32691, 
--32698, -32704, -32709, -32715, -32720, -32725, -32729, -32734, -32738, -32741, 
--32745, -32748, -32751, -32754, -32756, -32759, -32760, -32762, -32763, -32765, 
--32765, -32766, -32766, -32766, -32766, -32766, -32765, -32764, -32763, -32761, 
--32760, -32757, -32755, -32753, -32750, -32747, -32743, -32739, -32736, -32731, 
--32727, -32722, -32717, -32712, -32706, -32701, -32695, -32688, -32682, -32675, 
--32668, -32660, -32653, -32645, -32637, -32628, -32620, -32611, -32601, -32592, 
--32582, -32572, -32562, -32551, -32540, -32529, -32518, -32506, -32494, -32482, 
--32470, -32457, -32444, -32431, -32418, -32404, -32390, -32376, -32361, -32346, 
--32331, -32316, -32301, -32285, -32269, -32252, -32236, -32219, -32202, -32184, 
--32167, -32149, -32131, -32112, -32093, -32075, -32055, -32036, -32016, -31996, 
--31976, -31955, -31935, -31914, -31892, -31871, -31849, -31827, -31804, -31782, 
--31759, -31736, -31713, -31689, -31665, -31641, -31617, -31592, -31567, -31542, 
--31516, -31491, -31465, -31439, -31412, -31385, -31359, -31331, -31304, -31276, 
--31248, -31220, -31191, -31163, -31134, -31105, -31075, -31045, -31015, -30985, 
--30955, -30924, -30893, -30862, -30830, -30798, -30766, -30734, -30702, -30669, 
--30636, -30603, -30569, -30535, -30501, -30467, -30433, -30398, -30363, -30328, 
--30292, -30257, -30221, -30184, -30148, -30111, -30074, -30037, -30000, -29962, 
--29924, -29886, -29848, -29809, -29770, -29731, -29692, -29652, -29612, -29572, 
--29532, -29491, -29450, -29409, -29368, -29326, -29285, -29243, -29200, -29158, 
--29115, -29072, -29029, -28986, -28942, -28898, -28854, -28810, -28765, -28720, 
--28675, -28630, -28584, -28539, -28493, -28446, -28400, -28353, -28306, -28259, 
--28212, -28164, -28116, -28068, -28020, -27971, -27923, -27874, -27825, -27775, 
--27725, -27676, -27625, -27575, -27525, -27474, -27423, -27372, -27320, -27269, 
--27217, -27165, -27112, -27060, -27007, -26954, -26901, -26847, -26794, -26740, 
--26686, -26631, -26577, -26522, -26467, -26412, -26357, -26301, -26245, -26189, 
--26133, -26077, -26020, -25963, -25906, -25849, -25791, -25734, -25676, -25618, 
--25559, -25501, -25442, -25383, -25324, -25265, -25205, -25145, -25085, -25025, 
--24965, -24904, -24844, -24783, -24721, -24660, -24598, -24537, -24475, -24413, 
--24350, -24288, -24225, -24162, -24099, -24035, -23972, -23908, -23844, -23780, 
--23716, -23651, -23586, -23521, -23456, -23391, -23326, -23260, -23194, -23128, 
--23062, -22995, -22929, -22862, -22795, -22728, -22660, -22593, -22525, -22457, 
--22389, -22321, -22252, -22184, -22115, -22046, -21977, -21908, -21838, -21768, 
--21698, -21628, -21558, -21488, -21417, -21346, -21276, -21204, -21133, -21062, 
--20990, -20918, -20846, -20774, -20702, -20630, -20557, -20484, -20411, -20338, 
--20265, -20191, -20118, -20044, -19970, -19896, -19822, -19747, -19673, -19598, 
--19523, -19448, -19373, -19297, -19222, -19146, -19070, -18994, -18918, -18842, 
--18765, -18689, -18612, -18535, -18458, -18381, -18303, -18226, -18148, -18070, 
--17992, -17914, -17836, -17758, -17679, -17600, -17521, -17442, -17363, -17284, 
--17205, -17125, -17046, -16966, -16886, -16806, -16725, -16645, -16565, -16484, 
--16403, -16322, -16241, -16160, -16079, -15997, -15916, -15834, -15752, -15670, 
--15588, -15506, -15424, -15341, -15259, -15176, -15093, -15010, -14927, -14844, 
--14761, -14677, -14594, -14510, -14427, -14343, -14259, -14174, -14090, -14006, 
--13921, -13837, -13752, -13667, -13582, -13497, -13412, -13327, -13242, -13156, 
--13071, -12985, -12899, -12813, -12727, -12641, -12555, -12469, -12382, -12296, 
--12209, -12123, -12036, -11949, -11862, -11775, -11688, -11600, -11513, -11426, 
--11338, -11250, -11163, -11075, -10987, -10899, -10811, -10723, -10634, -10546, 
--10457, -10369, -10280, -10192, -10103, -10014, -9925, -9836, -9747, -9658, 
--9568, -9479, -9390, -9300, -9211, -9121, -9031, -8942, -8852, -8762, 
--8672, -8582, -8491, -8401, -8311, -8221, -8130, -8040, -7949, -7859, 
--7768, -7677, -7586, -7496, -7405, -7314, -7223, -7131, -7040, -6949, 
--6858, -6766, -6675, -6584, -6492, -6401, -6309, -6217, -6126, -6034, 
--5942, -5850, -5758, -5666, -5574, -5482, -5390, -5298, -5206, -5114, 
--5022, -4929, -4837, -4745, -4652, -4560, -4467, -4375, -4282, -4190, 
--4097, -4004, -3912, -3819, -3726, -3633, -3541, -3448, -3355, -3262, 
--3169, -3076, -2983, -2890, -2797, -2704, -2611, -2518, -2425, -2332, 
--2239, -2145, -2052, -1959, -1866, -1773, -1679, -1586, -1493, -1400, 
--1306, -1213, -1120, -1026, -933, -840, -746, -653, -560, -466, 
--373, -280, -186, -93,
-};
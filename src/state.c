@@ -0,0 +1,842 @@
+/*
+	This file is part of FreeChaF.
+
+	FreeChaF is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	FreeChaF is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <string.h>
+#include <time.h>
+#include <retro_endianness.h>
+#include "state.h"
+#include "channelf.h"
+#include "memory.h"
+#include "f8.h"
+#include "video.h"
+
+#define HEADER_SIZE 8 // "FCHF", version, reserved
+#define CHUNK_HEADER_SIZE 8 // tag, length
+
+enum
+{
+	CHUNK_CPU,
+	CHUNK_MEM,
+	CHUNK_VRAM,
+	CHUNK_PORT,
+	CHUNK_2102,
+	CHUNK_AUDIO,
+	CHUNK_CTRL,
+	CHUNK_HLE,
+	CHUNK_HOST, // optional from here on
+	CHUNK_MARK, // fixed layouts only
+	CHUNKS
+};
+
+// Tags and the payload size this version writes, a loader takes longer
+// ones and ignores the rest. MEM is followed by the RAM pages in use.
+static const struct
+{
+	char tag[5];
+	uint32_t size;
+} chunkInfo[CHUNKS] =
+{
+	{ "CPU ", R_SIZE + 3 + 4*2 + 4 }, // scratchpad, A, ISAR, W, PC0, PC1, DC0, DC1, tick debt
+	{ "MEM ", 2 + 1 + MEMORY_PAGES/8 }, // RAM start, multicart bank, bit per page stored
+	{ "VRAM", 4 + VIDEO_SIZE/4 },       // ARM, X, Y, color, 2 bit pixels
+	{ "PORT", 64 },
+	{ "2102", 2 + 2 + 1 + 1024/8 },     // state, address, rw, 1 bit cells
+	{ "AUD ", 1 + 2 + 4 + 4 },          // tone, amp, sample in cycle, sample fraction
+	{ "CTRL", 3 + 1 + 1 + 1 + 1 },      // state, enabled, swapped, cursor position, cursor down
+	{ "HLE ", 4 },                      // screen clear row, palette and color, delay counter
+	{ "HOST", 1 + 10 + 10 },            // console input, joypads
+	{ "MARK", 4 + 4 },                  // instance, STATE_mark it was saved at
+};
+
+static const uint8_t zeroPage[MEMORY_PAGE_SIZE];
+
+// the console button overlay cursor is on one of five buttons
+#define CURSOR_X(x) ((x) <= 4 ? (x) : 4)
+
+// a frame overruns by less than one HLE step, out of range debts would
+// run or stall the machine for minutes
+#define TICKS_DEBT_MAX (TICKS_PER_FRAME + TICKS_PER_ROW)
+#define TICKS_DEBT(x) ((x) < 0 ? 0 : (x) > TICKS_DEBT_MAX ? TICKS_DEBT_MAX : (x))
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+	return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+	return p + 4;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint8_t *putChunk(uint8_t *p, int chunk, uint32_t size)
+{
+	memcpy(p, chunkInfo[chunk].tag, 4);
+	return put32(p + 4, size);
+}
+
+// RAM of a page, from MEMORY_RAMStart in the page holding it
+static uint32_t pageStart(struct channelf *ctx, uint32_t page)
+{
+	uint32_t address = page << MEMORY_PAGE_SHIFT;
+	return address < (uint32_t)ctx->MEMORY_RAMStart ? (uint32_t)ctx->MEMORY_RAMStart : address;
+}
+
+size_t STATE_size(struct channelf *ctx)
+{
+	size_t size = HEADER_SIZE + CHUNK_HEADER_SIZE; // and the END chunk
+	int i;
+
+	for(i=0; i<CHUNKS; i++)
+	{
+		size += CHUNK_HEADER_SIZE + chunkInfo[i].size;
+	}
+	return size + MEMORY_SIZE - ctx->MEMORY_RAMStart; // every RAM page in use
+}
+
+// Bytes of a fixed layout MEM chunk, every page of RAM stored
+static uint32_t fixedMemSize(struct channelf *ctx)
+{
+	return chunkInfo[CHUNK_MEM].size + MEMORY_SIZE - ctx->MEMORY_RAMStart;
+}
+
+// Everything in RAM, VRAM and the 2102 counts as changed now, for after
+// they were written around the write sites
+static void touchAll(struct channelf *ctx)
+{
+	int i;
+
+	for(i=0; i<MEMORY_PAGES; i++)
+		ctx->MEMORY_Written[i] = ctx->STATE_Epoch;
+	for(i=0; i<VIDEO_HEIGHT; i++)
+		ctx->VIDEO_Written[i] = ctx->STATE_Epoch;
+	ctx->f2102_Written = ctx->STATE_Epoch;
+}
+
+uint32_t STATE_mark(struct channelf *ctx)
+{
+	return ++ctx->STATE_Epoch;
+}
+
+// The parts of the machine small enough to write whole every time, in
+// savestates and STATE_hash
+
+static uint8_t *putCPU(struct channelf *ctx, uint8_t *p)
+{
+	memcpy(p, ctx->F8_R, R_SIZE);
+	p += R_SIZE;
+	*p++ = ctx->F8_A;
+	*p++ = ctx->F8_ISAR;
+	*p++ = F8_getW(ctx);
+	p = put16(p, ctx->F8_PC0);
+	p = put16(p, ctx->F8_PC1);
+	p = put16(p, ctx->F8_DC0);
+	p = put16(p, ctx->F8_DC1);
+	return put32(p, ctx->CPU_Ticks_Debt);
+}
+
+static uint8_t *putVideo(struct channelf *ctx, uint8_t *p)
+{
+	*p++ = ctx->VIDEO_ARM;
+	*p++ = ctx->VIDEO_X;
+	*p++ = ctx->VIDEO_Y;
+	*p++ = ctx->VIDEO_Color;
+	return p;
+}
+
+static uint8_t *put2102(struct channelf *ctx, uint8_t *p)
+{
+	p = put16(p, ctx->f2102_state);
+	p = put16(p, ctx->f2102_address);
+	*p++ = ctx->f2102_rw;
+	return p;
+}
+
+static uint8_t *putAudio(struct channelf *ctx, uint8_t *p)
+{
+	*p++ = ctx->AUDIO_tone;
+	p = put16(p, ctx->AUDIO_amp);
+	p = put32(p, ctx->AUDIO_sampleInCycle);
+	return put32(p, ctx->AUDIO_ticks);
+}
+
+static uint8_t *putControllers(struct channelf *ctx, uint8_t *p)
+{
+	memcpy(p, ctx->CONTROLLER_State, sizeof(ctx->CONTROLLER_State));
+	p += sizeof(ctx->CONTROLLER_State);
+	*p++ = ctx->ControllerEnabled;
+	*p++ = ctx->ControllerSwapped;
+	*p++ = ctx->cursorX;
+	*p++ = ctx->cursorDown;
+	return p;
+}
+
+// whether the BIOS is emulated and fast screen clear are settings, not state
+static uint8_t *putHLE(struct channelf *ctx, uint8_t *p)
+{
+	*p++ = ctx->hle_state.screen_clear_row;
+	*p++ = ctx->hle_state.screen_clear_pal;
+	*p++ = ctx->hle_state.screen_clear_color;
+	*p++ = ctx->hle_state.delay_counter;
+	return p;
+}
+
+// Fixed layouts record the machine and mark they were saved with, so
+// only a state this machine saved at mark is taken to hold what wasn't
+// written since. A buffer freed and allocated again, or with another
+// state copied in, doesn't match.
+static int savedAt(struct channelf *ctx, const uint8_t **chunks, uint32_t mark)
+{
+	const uint8_t *p = chunks[CHUNK_MARK];
+
+	return p && get32(p) == ctx->STATE_Instance && get32(p + 4) == mark;
+}
+
+// With since set, data already holds a fixed layout state of the machine
+// at that mark and RAM pages, VRAM rows and 2102 cells not written from
+// then on are left as they are. Fixed layouts are marked with mark.
+static size_t saveState(struct channelf *ctx, const struct state_host *host, void *data, size_t size, int allPages, uint32_t since, uint32_t mark)
+{
+	uint8_t *p = (uint8_t *)data;
+	uint8_t *chunk;
+	uint8_t *pages;
+	uint32_t page;
+	int row;
+	int i;
+
+	if(size < STATE_size(ctx))
+	{
+		return 0;
+	}
+
+	memcpy(p, "FCHF", 4);
+	p = put16(p + 4, STATE_VERSION);
+	p = put16(p, 0);
+
+	p = putChunk(p, CHUNK_CPU, chunkInfo[CHUNK_CPU].size);
+	p = putCPU(ctx, p);
+
+	// Pages of RAM holding only zeros are left out, which is most of them,
+	// unless the layout has to stay fixed
+	chunk = p;
+	p = putChunk(p, CHUNK_MEM, 0);
+	p = put16(p, ctx->MEMORY_RAMStart);
+	*p++ = ctx->MEMORY_Multicart;
+	pages = p;
+	memset(pages, 0, MEMORY_PAGES/8);
+	p += MEMORY_PAGES/8;
+	for(page=ctx->MEMORY_RAMStart >> MEMORY_PAGE_SHIFT; page<MEMORY_PAGES; page++)
+	{
+		uint32_t start = pageStart(ctx, page);
+		uint32_t length = ((page + 1) << MEMORY_PAGE_SHIFT) - start;
+
+		if(since && ctx->MEMORY_Written[page] < since)
+		{
+			pages[page >> 3] |= 0x80 >> (page & 7);
+			p += length;
+			continue;
+		}
+		MEMORY_readRAM(ctx, start, p, length);
+		if(allPages || memcmp(p, zeroPage, length))
+		{
+			pages[page >> 3] |= 0x80 >> (page & 7);
+			p += length;
+		}
+	}
+	put32(chunk + 4, p - chunk - CHUNK_HEADER_SIZE);
+
+	p = putChunk(p, CHUNK_VRAM, chunkInfo[CHUNK_VRAM].size);
+	p = putVideo(ctx, p);
+	for(row=0; row<VIDEO_HEIGHT; row++)
+	{
+		const uint8_t *pixel = &ctx->VIDEO_Buffer_raw[row << 7];
+
+		if(since && ctx->VIDEO_Written[row] < since)
+		{
+			p += 128/4;
+			continue;
+		}
+		for(i=0; i<128; i+=4, pixel+=4)
+			*p++ = ((pixel[0] & 3) << 6) | ((pixel[1] & 3) << 4) | ((pixel[2] & 3) << 2) | (pixel[3] & 3);
+	}
+
+	p = putChunk(p, CHUNK_PORT, chunkInfo[CHUNK_PORT].size);
+	memcpy(p, ctx->Ports, sizeof(ctx->Ports));
+	p += sizeof(ctx->Ports);
+
+	p = putChunk(p, CHUNK_2102, chunkInfo[CHUNK_2102].size);
+	p = put2102(ctx, p);
+	if(!since || ctx->f2102_Written >= since)
+	{
+		memset(p, 0, sizeof(ctx->f2102_memory)/8);
+		for(i=0; i<(int)sizeof(ctx->f2102_memory); i++)
+		{
+			if(ctx->f2102_memory[i])
+				p[i >> 3] |= 0x80 >> (i & 7);
+		}
+	}
+	p += sizeof(ctx->f2102_memory)/8;
+
+	p = putChunk(p, CHUNK_AUDIO, chunkInfo[CHUNK_AUDIO].size);
+	p = putAudio(ctx, p);
+
+	p = putChunk(p, CHUNK_CTRL, chunkInfo[CHUNK_CTRL].size);
+	p = putControllers(ctx, p);
+
+	p = putChunk(p, CHUNK_HLE, chunkInfo[CHUNK_HLE].size);
+	p = putHLE(ctx, p);
+
+	if(host)
+	{
+		p = putChunk(p, CHUNK_HOST, chunkInfo[CHUNK_HOST].size);
+		*p++ = host->console_input;
+		memcpy(p, host->joypad0, sizeof(host->joypad0));
+		p += sizeof(host->joypad0);
+		memcpy(p, host->joypad1, sizeof(host->joypad1));
+		p += sizeof(host->joypad1);
+	}
+
+	if(allPages)
+	{
+		p = putChunk(p, CHUNK_MARK, chunkInfo[CHUNK_MARK].size);
+		p = put32(p, ctx->STATE_Instance);
+		p = put32(p, mark);
+	}
+
+	memcpy(p, "END ", 4);
+	p = put32(p + 4, 0);
+
+	memset(p, 0, (uint8_t *)data + size - p);
+	return p - (uint8_t *)data;
+}
+
+size_t STATE_save(struct channelf *ctx, const struct state_host *host, void *data, size_t size)
+{
+	return saveState(ctx, host, data, size, 0, 0, 0);
+}
+
+size_t STATE_saveFixed(struct channelf *ctx, const struct state_host *host, void *data, size_t size)
+{
+	// what is written from here on is stamped with the epoch or a later one
+	return saveState(ctx, host, data, size, 1, 0, ctx->STATE_Epoch);
+}
+
+// Find the chunks of a state and check they fit the machine, so that a
+// bad state is refused before anything is changed
+static int findChunks(struct channelf *ctx, const uint8_t *data, size_t size, const uint8_t **chunks, uint32_t *sizes)
+{
+	size_t pos = HEADER_SIZE;
+	const uint8_t *mem;
+	uint32_t expected;
+	uint32_t page;
+	int i;
+
+	if(size < HEADER_SIZE || memcmp(data, "FCHF", 4) || get16(data + 4) > STATE_VERSION)
+	{
+		return 0;
+	}
+
+	memset(chunks, 0, CHUNKS * sizeof(*chunks));
+	while(pos + CHUNK_HEADER_SIZE <= size && memcmp(data + pos, "END ", 4))
+	{
+		const uint8_t *tag = data + pos;
+		uint32_t length = get32(data + pos + 4);
+
+		pos += CHUNK_HEADER_SIZE;
+		if(length > size - pos)
+		{
+			return 0;
+		}
+		for(i=0; i<CHUNKS; i++)
+		{
+			if(!memcmp(tag, chunkInfo[i].tag, 4))
+			{
+				if(length < chunkInfo[i].size)
+				{
+					return 0;
+				}
+				chunks[i] = data + pos;
+				sizes[i] = length;
+			}
+		}
+		pos += length;
+	}
+
+	for(i=0; i<CHUNK_HOST; i++)
+	{
+		if(!chunks[i])
+		{
+			return 0;
+		}
+	}
+
+	// RAM must be laid out as on the machine
+	mem = chunks[CHUNK_MEM];
+	if(get16(mem) != ctx->MEMORY_RAMStart)
+	{
+		return 0;
+	}
+	expected = chunkInfo[CHUNK_MEM].size;
+	for(page=0; page<MEMORY_PAGES; page++)
+	{
+		if(mem[3 + (page >> 3)] & (0x80 >> (page & 7)))
+		{
+			if(((page + 1) << MEMORY_PAGE_SHIFT) <= (uint32_t)ctx->MEMORY_RAMStart)
+				return 0;
+			expected += ((page + 1) << MEMORY_PAGE_SHIFT) - pageStart(ctx, page);
+		}
+	}
+	return sizes[CHUNK_MEM] == expected;
+}
+
+size_t STATE_saveDirty(struct channelf *ctx, const struct state_host *host, void *data, size_t size, uint32_t *mark)
+{
+	const uint8_t *chunks[CHUNKS];
+	uint32_t sizes[CHUNKS];
+	uint32_t since = *mark;
+	uint32_t next;
+	size_t used;
+
+	// anything but a fixed layout this machine saved at *mark, with the
+	// host chunk where it will be written, is saved in full
+	if(since && !(findChunks(ctx, (const uint8_t *)data, size, chunks, sizes) &&
+		get16((const uint8_t *)data + 4) == STATE_VERSION &&
+		sizes[CHUNK_MEM] == fixedMemSize(ctx) &&
+		!host == !chunks[CHUNK_HOST] &&
+		savedAt(ctx, chunks, since)))
+	{
+		since = 0;
+	}
+	next = STATE_mark(ctx);
+	used = saveState(ctx, host, data, size, 1, since, next);
+	if(used)
+	{
+		*mark = next;
+	}
+	return used;
+}
+
+// With since set and data a fixed layout this machine saved at that mark,
+// RAM pages, VRAM rows and 2102 cells not written from then on are left
+// as they are
+static int loadChunks(struct channelf *ctx, struct state_host *host, const uint8_t *data, size_t size, uint32_t since)
+{
+	const uint8_t *chunks[CHUNKS];
+	uint32_t sizes[CHUNKS];
+	const uint8_t *p;
+	const uint8_t *pages;
+	uint32_t page;
+	int row;
+	int i;
+
+	if(!findChunks(ctx, data, size, chunks, sizes))
+	{
+		return 0;
+	}
+	if(since && !(sizes[CHUNK_MEM] == fixedMemSize(ctx) && savedAt(ctx, chunks, since)))
+	{
+		since = 0;
+	}
+
+	// Registers narrower than their bytes are masked to the bits the
+	// hardware has, some of them index arrays
+
+	p = chunks[CHUNK_CPU];
+	memcpy(ctx->F8_R, p, R_SIZE);
+	p += R_SIZE;
+	ctx->F8_A = p[0];
+	ctx->F8_ISAR = p[1] & 0x3F;
+	F8_setW(ctx, p[2]);
+	ctx->F8_PC0 = get16(p + 3);
+	ctx->F8_PC1 = get16(p + 5);
+	ctx->F8_DC0 = get16(p + 7);
+	ctx->F8_DC1 = get16(p + 9);
+	ctx->CPU_Ticks_Debt = TICKS_DEBT((int32_t)get32(p + 11));
+
+	p = chunks[CHUNK_MEM];
+	ctx->MEMORY_Multicart = p[2];
+	MEMORY_remap(ctx);
+	pages = p + 3;
+	p += chunkInfo[CHUNK_MEM].size;
+	for(page=ctx->MEMORY_RAMStart >> MEMORY_PAGE_SHIFT; page<MEMORY_PAGES; page++)
+	{
+		uint32_t start = pageStart(ctx, page);
+		uint32_t length = ((page + 1) << MEMORY_PAGE_SHIFT) - start;
+
+		if(since && ctx->MEMORY_Written[page] < since)
+		{
+			p += length;
+		}
+		else if(pages[page >> 3] & (0x80 >> (page & 7)))
+		{
+			MEMORY_writeRAM(ctx, start, p, length);
+			p += length;
+		}
+		else
+		{
+			MEMORY_writeRAM(ctx, start, zeroPage, length);
+		}
+	}
+
+	p = chunks[CHUNK_VRAM];
+	ctx->VIDEO_ARM = p[0];
+	ctx->VIDEO_X = p[1] & 0x7F;
+	ctx->VIDEO_Y = p[2] & 0x3F;
+	ctx->VIDEO_Color = p[3] & 3;
+	p += 4;
+	// only rows that change are redrawn, run-ahead loads a state every frame
+	for(row=0; row<VIDEO_HEIGHT; row++)
+	{
+		uint8_t pixels[128];
+
+		if(since && ctx->VIDEO_Written[row] < since)
+		{
+			p += 128/4;
+			continue;
+		}
+		for(i=0; i<128; i+=4, p++)
+		{
+			pixels[i] = *p >> 6;
+			pixels[i+1] = (*p >> 4) & 3;
+			pixels[i+2] = (*p >> 2) & 3;
+			pixels[i+3] = *p & 3;
+		}
+		if(memcmp(&ctx->VIDEO_Buffer_raw[row << 7], pixels, 128))
+		{
+			memcpy(&ctx->VIDEO_Buffer_raw[row << 7], pixels, 128);
+			ctx->VIDEO_Dirty |= VIDEO_ROW(row);
+			ctx->VIDEO_Written[row] = ctx->STATE_Epoch;
+		}
+	}
+
+	memcpy(ctx->Ports, chunks[CHUNK_PORT], sizeof(ctx->Ports));
+
+	p = chunks[CHUNK_2102];
+	ctx->f2102_state = get16(p);
+	ctx->f2102_address = get16(p + 2) & 0x3FF;
+	ctx->f2102_rw = p[4];
+	p += 5;
+	if(!since || ctx->f2102_Written >= since)
+	{
+		for(i=0; i<(int)sizeof(ctx->f2102_memory); i++)
+		{
+			uint8_t bit = (p[i >> 3] >> (7 - (i & 7))) & 1;
+
+			if(ctx->f2102_memory[i] != bit)
+			{
+				ctx->f2102_memory[i] = bit;
+				ctx->f2102_Written = ctx->STATE_Epoch;
+			}
+		}
+	}
+
+	p = chunks[CHUNK_AUDIO];
+	ctx->AUDIO_tone = p[0] & 3;
+	ctx->AUDIO_amp = AUDIO_AMP((int16_t)get16(p + 1));
+	ctx->AUDIO_sampleInCycle = get32(p + 3);
+	ctx->AUDIO_ticks = get32(p + 7);
+
+	p = chunks[CHUNK_CTRL];
+	memcpy(ctx->CONTROLLER_State, p, sizeof(ctx->CONTROLLER_State));
+	p += sizeof(ctx->CONTROLLER_State);
+	ctx->ControllerEnabled = p[0];
+	ctx->ControllerSwapped = p[1] & 1;
+	ctx->cursorX = CURSOR_X(p[2]);
+	ctx->cursorDown = p[3];
+
+	p = chunks[CHUNK_HLE];
+	ctx->hle_state.screen_clear_row = p[0] & 0x3F;
+	ctx->hle_state.screen_clear_pal = p[1] & 3;
+	ctx->hle_state.screen_clear_color = p[2] & 3;
+	ctx->hle_state.delay_counter = p[3];
+
+	if(host && chunks[CHUNK_HOST])
+	{
+		p = chunks[CHUNK_HOST];
+		host->console_input = p[0];
+		memcpy(host->joypad0, p + 1, sizeof(host->joypad0));
+		memcpy(host->joypad1, p + 11, sizeof(host->joypad1));
+	}
+	return 1;
+}
+
+// The layout before the chunks: the struct itself with its compiler's
+// padding, multibyte fields big endian. The fields from cursorX on were
+// added later, states without them are LEGACY_SHORT_SIZE bytes.
+struct legacy_state
+{
+	unsigned int CPU_Ticks_Debt;
+	uint8_t Memory[MEMORY_SIZE];
+	uint8_t F8_R[R_SIZE];
+	uint8_t VIDEO_Buffer[8192];
+	uint8_t Ports[64];
+
+	uint16_t F8_PC0;
+	uint16_t F8_PC1;
+	uint16_t F8_DC0;
+	uint16_t F8_DC1;
+	uint8_t F8_ISAR;
+	uint8_t F8_W;
+
+	uint16_t f2102_state;
+	uint8_t f2102_memory[1024];
+	uint16_t f2102_address;
+	uint8_t f2102_rw;
+	uint8_t F8_A;
+
+	uint8_t VIDEO_ARM, VIDEO_X, VIDEO_Y, VIDEO_Color;
+	uint8_t ControllerEnabled;
+	uint8_t ControllerSwapped;
+
+	uint8_t console_input;
+	uint8_t AUDIO_tone;
+	uint16_t AUDIO_amp;
+
+	// psu1_hle, psu2_hle, fast_screen_clear, screen_clear_row,
+	// screen_clear_pal, screen_clear_color, delay_counter
+	uint8_t hle_state[7];
+
+	unsigned int cursorX;
+	unsigned int cursorDown;
+
+	unsigned int AUDIO_sampleInCycle;
+	unsigned int AUDIO_ticks;
+
+	uint8_t joypad0[10];
+	uint8_t joypad1[10];
+
+	uint8_t CONTROLLER_State[3];
+	uint8_t MEMORY_Multicart;
+};
+
+#define LEGACY_SHORT_SIZE (sizeof(struct legacy_state) - 41)
+
+static int loadLegacy(struct channelf *ctx, struct state_host *host, const void *data, size_t size)
+{
+	const struct legacy_state *st = (const struct legacy_state *)data;
+	int i;
+
+	if(size < LEGACY_SHORT_SIZE)
+	{
+		return 0;
+	}
+
+	memcpy(ctx->Memory + ctx->MEMORY_RAMStart, st->Memory + ctx->MEMORY_RAMStart, MEMORY_SIZE - ctx->MEMORY_RAMStart);
+	memcpy(ctx->F8_R, st->F8_R, R_SIZE);
+	for(i=0; i<(int)sizeof(ctx->VIDEO_Buffer_raw); i++)
+		ctx->VIDEO_Buffer_raw[i] = st->VIDEO_Buffer[i] & 3;
+	VIDEO_invalidate(ctx);
+	memcpy(ctx->Ports, st->Ports, sizeof(ctx->Ports));
+	memcpy(ctx->f2102_memory, st->f2102_memory, sizeof(ctx->f2102_memory));
+	touchAll(ctx);
+
+	ctx->F8_A = st->F8_A;
+	ctx->F8_ISAR = st->F8_ISAR & 0x3F;
+	F8_setW(ctx, st->F8_W);
+
+	ctx->F8_PC0 = retro_be_to_cpu16(st->F8_PC0);
+	ctx->F8_PC1 = retro_be_to_cpu16(st->F8_PC1);
+	ctx->F8_DC0 = retro_be_to_cpu16(st->F8_DC0);
+	ctx->F8_DC1 = retro_be_to_cpu16(st->F8_DC1);
+
+	ctx->VIDEO_X = st->VIDEO_X & 0x7F;
+	ctx->VIDEO_Y = st->VIDEO_Y & 0x3F;
+	ctx->VIDEO_Color = st->VIDEO_Color & 3;
+	ctx->VIDEO_ARM = st->VIDEO_ARM;
+
+	ctx->f2102_rw = st->f2102_rw;
+	ctx->f2102_address = retro_be_to_cpu16(st->f2102_address) & 0x3FF;
+	ctx->f2102_state = retro_be_to_cpu16(st->f2102_state);
+
+	ctx->ControllerEnabled = st->ControllerEnabled;
+	ctx->ControllerSwapped = st->ControllerSwapped & 1;
+
+	ctx->hle_state.screen_clear_row = st->hle_state[3] & 0x3F;
+	ctx->hle_state.screen_clear_pal = st->hle_state[4] & 3;
+	ctx->hle_state.screen_clear_color = st->hle_state[5] & 3;
+	ctx->hle_state.delay_counter = 0;
+
+	ctx->AUDIO_tone = st->AUDIO_tone & 3;
+	ctx->AUDIO_amp = AUDIO_AMP((int16_t)retro_be_to_cpu16(st->AUDIO_amp));
+	ctx->AUDIO_ticks = 0; // was in another unit
+	ctx->CPU_Ticks_Debt = TICKS_DEBT((int32_t)retro_be_to_cpu32(st->CPU_Ticks_Debt));
+
+	if(host)
+	{
+		host->console_input = st->console_input;
+	}
+
+	if(size >= sizeof(struct legacy_state))
+	{
+		ctx->hle_state.delay_counter = st->hle_state[6];
+
+		ctx->cursorX = CURSOR_X(retro_be_to_cpu32(st->cursorX));
+		ctx->cursorDown = retro_be_to_cpu32(st->cursorDown);
+
+		ctx->AUDIO_sampleInCycle = retro_be_to_cpu32(st->AUDIO_sampleInCycle);
+
+		if(host)
+		{
+			memcpy(host->joypad0, st->joypad0, sizeof(host->joypad0));
+			memcpy(host->joypad1, st->joypad1, sizeof(host->joypad1));
+		}
+
+		memcpy(ctx->CONTROLLER_State, st->CONTROLLER_State, sizeof(st->CONTROLLER_State));
+
+		ctx->MEMORY_Multicart = st->MEMORY_Multicart;
+	}
+	MEMORY_remap(ctx);
+	return 1;
+}
+
+int STATE_load(struct channelf *ctx, struct state_host *host, const void *data, size_t size)
+{
+	if(size >= 4 && !memcmp(data, "FCHF", 4))
+	{
+		return loadChunks(ctx, host, (const uint8_t *)data, size, 0);
+	}
+	return loadLegacy(ctx, host, data, size);
+}
+
+int STATE_loadDirty(struct channelf *ctx, struct state_host *host, const void *data, size_t size, uint32_t mark)
+{
+	if(size >= 4 && !memcmp(data, "FCHF", 4))
+	{
+		return loadChunks(ctx, host, (const uint8_t *)data, size, mark);
+	}
+	return loadLegacy(ctx, host, data, size);
+}
+
+// Hashes are taken on the bytes in a fixed order, so they are the same on
+// every host. They only have to tell states apart, not resist attacks.
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+static uint64_t hashBytes(uint64_t seed, const uint8_t *p, size_t size)
+{
+	uint64_t h = (seed + size) * HASH_MULTIPLIER;
+
+	for(; size >= 8; size -= 8, p += 8)
+	{
+		uint64_t word = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint64_t)p[3] << 24) |
+			((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+
+		h = (h ^ word) * HASH_MULTIPLIER;
+		h ^= h >> 29;
+	}
+	for(; size; size--, p++)
+	{
+		h = (h ^ *p) * HASH_MULTIPLIER;
+		h ^= h >> 29;
+	}
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	return h ^ (h >> 33);
+}
+
+// Machines alive at the same time differ in address, and one set up
+// again at the same address differs in time
+void STATE_init(struct channelf *ctx)
+{
+	uint64_t now[2];
+
+	now[0] = (uint64_t)time(NULL);
+	now[1] = (uint64_t)clock();
+	ctx->STATE_Instance = (uint32_t)(hashBytes((uint64_t)(uintptr_t)ctx, (const uint8_t *)now, sizeof(now)) >> 32);
+}
+
+// Each region is hashed with its own seed, so the XOR of them all still
+// tells where a change was
+static void rehash(struct channelf *ctx, uint64_t *cached, uint64_t h)
+{
+	ctx->STATE_BulkHash ^= *cached ^ h;
+	*cached = h;
+}
+
+uint64_t STATE_hash(struct channelf *ctx)
+{
+	uint8_t buffer[MEMORY_PAGE_SIZE];
+	uint8_t *p = buffer;
+	uint32_t since = ctx->STATE_HashMark;
+	uint32_t page;
+	int row;
+
+	if(ctx->STATE_HashRAMStart != ctx->MEMORY_RAMStart) // another cart
+	{
+		since = 0;
+	}
+	if(!since)
+	{
+		memset(ctx->STATE_PageHash, 0, sizeof(ctx->STATE_PageHash));
+		memset(ctx->STATE_RowHash, 0, sizeof(ctx->STATE_RowHash));
+		ctx->STATE_2102Hash = 0;
+		ctx->STATE_BulkHash = 0;
+		ctx->STATE_HashRAMStart = ctx->MEMORY_RAMStart;
+	}
+
+	for(page=ctx->MEMORY_RAMStart >> MEMORY_PAGE_SHIFT; page<MEMORY_PAGES; page++)
+	{
+		uint32_t start = pageStart(ctx, page);
+		uint32_t length = ((page + 1) << MEMORY_PAGE_SHIFT) - start;
+
+		if(since && ctx->MEMORY_Written[page] < since)
+			continue;
+		MEMORY_readRAM(ctx, start, buffer, length);
+		rehash(ctx, &ctx->STATE_PageHash[page], hashBytes(page, buffer, length));
+	}
+	for(row=0; row<VIDEO_HEIGHT; row++)
+	{
+		if(since && ctx->VIDEO_Written[row] < since)
+			continue;
+		rehash(ctx, &ctx->STATE_RowHash[row], hashBytes(MEMORY_PAGES + row, &ctx->VIDEO_Buffer_raw[row << 7], 128));
+	}
+	if(!since || ctx->f2102_Written >= since)
+	{
+		rehash(ctx, &ctx->STATE_2102Hash, hashBytes(MEMORY_PAGES + VIDEO_HEIGHT, ctx->f2102_memory, sizeof(ctx->f2102_memory)));
+	}
+	ctx->STATE_HashMark = STATE_mark(ctx);
+
+	// the rest is a few dozen bytes, hashed every time
+	p = putCPU(ctx, p);
+	p = put16(p, ctx->MEMORY_RAMStart);
+	*p++ = ctx->MEMORY_Multicart;
+	p = putVideo(ctx, p);
+	memcpy(p, ctx->Ports, sizeof(ctx->Ports));
+	p += sizeof(ctx->Ports);
+	p = put2102(ctx, p);
+	p = putAudio(ctx, p);
+	p = putControllers(ctx, p);
+	p = putHLE(ctx, p);
+	return ctx->STATE_BulkHash ^ hashBytes(MEMORY_PAGES + VIDEO_HEIGHT + 1, buffer, p - buffer);
+}
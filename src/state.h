@@ -0,0 +1,91 @@
+#ifndef STATE_H
+#define STATE_H
+/*
+	This file is part of FreeChaF.
+
+	FreeChaF is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	FreeChaF is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct channelf;
+
+// Savestates are a header ("FCHF", version) followed by chunks, each a
+// four character tag, a length and that many bytes. All numbers are big
+// endian. Chunks a loader doesn't know are skipped, so later versions
+// can add some without breaking older ones.
+#define STATE_VERSION 1
+
+// Input state the libretro frontend code keeps, saved with the machine
+struct state_host
+{
+	uint8_t console_input;
+	uint8_t joypad0[10];
+	uint8_t joypad1[10];
+};
+
+// Pick the tag the fixed states of ctx are marked with, so they aren't
+// taken for those of another machine, or of ctx before it was set up
+// again. Called by CHANNELF_init.
+void STATE_init(struct channelf *ctx);
+
+// Bytes STATE_save needs at most with the current cart
+size_t STATE_size(struct channelf *ctx);
+
+// Write the machine and host (if not NULL) to data. The rest of data is
+// zeroed, so equal machines give equal buffers. Returns the bytes used,
+// 0 if size is below STATE_size.
+size_t STATE_save(struct channelf *ctx, const struct state_host *host, void *data, size_t size);
+
+// STATE_save keeping every RAM page, so all states of a cart are
+// STATE_size bytes that line up byte for byte, for deltas between them.
+// Fixed states end with a MARK chunk naming the machine that saved them
+// and the mark they were saved at, which STATE_saveDirty and
+// STATE_loadDirty check.
+size_t STATE_saveFixed(struct channelf *ctx, const struct state_host *host, void *data, size_t size);
+
+// STATE_saveFixed into data holding the state saved at *mark, copying
+// only the RAM pages, VRAM rows and 2102 cells written since then. The
+// rest of the state is small and always written. A *mark of 0, or data
+// not holding a fixed state this machine saved at *mark, saves
+// everything. *mark is set for the next call, and stays good for data
+// after the machine loads a state, as loads stamp what they change.
+// Writes made through pointers to the machine's memory handed out of
+// the core aren't seen.
+size_t STATE_saveDirty(struct channelf *ctx, const struct state_host *host, void *data, size_t size, uint32_t *mark);
+
+// Move on to a new epoch and return it. Writes from now on are stamped
+// with it, older ones compare lower.
+uint32_t STATE_mark(struct channelf *ctx);
+
+// Load a state written by STATE_save or the fixed layout used before it.
+// Nothing is changed when data isn't a state for the current cart.
+// Returns 1 on success.
+int STATE_load(struct channelf *ctx, struct state_host *host, const void *data, size_t size);
+
+// A 64 bit hash of everything STATE_save writes but the host input, the
+// same for equal machines on any host, to compare machines that should
+// be in step. Only the RAM pages, VRAM rows and 2102 written since the
+// last call are hashed again, so a call every frame costs little. The
+// hash depends on the audio rate, as savestates do.
+uint64_t STATE_hash(struct channelf *ctx);
+
+// STATE_load of data saved by STATE_saveDirty or STATE_saveFixed at mark,
+// restoring only the RAM pages, VRAM rows and 2102 cells written after
+// it was saved. Data saved at another mark, or by another machine, is
+// loaded in full.
+int STATE_loadDirty(struct channelf *ctx, struct state_host *host, const void *data, size_t size, uint32_t mark);
+
+#endif
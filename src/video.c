@@ -15,76 +15,384 @@
 	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
 */
 
+#include <string.h>
 #include "video.h"
+#include "channelf.h"
 
-pixel_t VIDEO_Buffer_rgb[8192]; // 128x64
-uint8_t VIDEO_Buffer_raw[8192]; // 128x64
-static const pixel_t colors[8] =
+#define RGB8888(r,g,b) (((r) << 16) | ((g) << 8) | (b))
+#define RGB1555(r,g,b) ((((r) & 0xf8) << 7) | (((g) & 0xf8) << 2) | (((b) & 0xf8) >> 3))
+#ifdef ABGR1555
+// the PS2 frontend takes RGB565 as its 16 bit format, laid out as ABGR1555
+#define RGB565(r,g,b) ((((b) & 0xf8) << 7) | (((g) & 0xf8) << 2) | (((r) & 0xf8) >> 3))
+#else
+#define RGB565(r,g,b) ((((r) & 0xf8) << 8) | (((g) & 0xfc) << 3) | (((b) & 0xf8) >> 3))
+#endif
+
+#define COLORS(pack) \
+  { \
+	  pack(0x10, 0x10, 0x10), \
+	  pack(0xFD, 0xFD, 0xFD), \
+	  pack(0x53, 0x31, 0xFF), \
+	  pack(0x5D, 0xCC, 0x02), \
+	  pack(0xF3, 0x3F, 0x4B), \
+	  pack(0xE0, 0xE0, 0xE0), \
+	  pack(0xA6, 0xFF, 0x91), \
+	  pack(0xD0, 0xCE, 0xFF) \
+  }
+static const uint32_t colors[VIDEO_FORMATS][8] = // indexed by enum video_format
   {
-	  vRGB(0x10, 0x10, 0x10),
-	  vRGB(0xFD, 0xFD, 0xFD),
-	  vRGB(0x53, 0x31, 0xFF),
-	  vRGB(0x5D, 0xCC, 0x02),
-	  vRGB(0xF3, 0x3F, 0x4B),
-	  vRGB(0xE0, 0xE0, 0xE0),
-	  vRGB(0xA6, 0xFF, 0x91),
-	  vRGB(0xD0, 0xCE, 0xFF)
+	  COLORS(RGB1555),
+	  COLORS(RGB8888),
+	  COLORS(RGB565)
   };
 static const uint8_t palette[16] = {0,1,1,1, 7,2,4,3, 6,2,4,3, 5,2,4,3}; // bk wh wh wh, bl B G R, gr B G R, gy B G R...
 
-uint8_t VIDEO_ARM = 0;
-uint8_t VIDEO_X = 0;
-uint8_t VIDEO_Y = 0;
-uint8_t VIDEO_Color = 2; 
+// Each visible pixel becomes scale x scale in the output. A row is
+// converted once by the converter for the pixel size and scale, and then
+// copied to the output lines below it. At 3x the SIMD paths take a group
+// of pixels per step through a compare and select on the row's four
+// colors.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
 
-void VIDEO_drawFrame(void)
+#include <emmintrin.h>
+
+static int convertRowSIMD16(const uint8_t *raw, const uint32_t *rowColors, uint16_t *out)
 {
-	int row;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i three = _mm_set1_epi16(3);
+	const __m128i c0 = _mm_set1_epi16((short)rowColors[0]);
+	const __m128i c1 = _mm_set1_epi16((short)rowColors[1]);
+	const __m128i c2 = _mm_set1_epi16((short)rowColors[2]);
+	const __m128i c3 = _mm_set1_epi16((short)rowColors[3]);
+	int col;
+
+	for(col=0; col+8<=VIDEO_WIDTH; col+=8)
+	{
+		__m128i idx = _mm_and_si128(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(raw+col)), zero), three);
+		__m128i p = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(c0, _mm_cmpeq_epi16(idx, zero)), _mm_and_si128(c1, _mm_cmpeq_epi16(idx, _mm_set1_epi16(1)))),
+			_mm_or_si128(_mm_and_si128(c2, _mm_cmpeq_epi16(idx, _mm_set1_epi16(2))), _mm_and_si128(c3, _mm_cmpeq_epi16(idx, three))));
+		__m128i lo = _mm_unpacklo_epi64(p, p); // p0-p3 in both halves
+		__m128i hi = _mm_unpackhi_epi64(p, p); // p4-p7 in both halves
+
+		// p0 p0 p0 p1 p1 p1 p2 p2 | p2 p3 p3 p3 p4 p4 p4 p5 | p5 p5 p6 p6 p6 p7 p7 p7
+		_mm_storeu_si128((__m128i *)out,     _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(1,0,0,0)), _MM_SHUFFLE(2,2,1,1)));
+		_mm_storeu_si128((__m128i *)out + 1, _mm_shufflehi_epi16(_mm_shufflelo_epi16(p,  _MM_SHUFFLE(3,3,3,2)), _MM_SHUFFLE(1,0,0,0)));
+		_mm_storeu_si128((__m128i *)out + 2, _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(2,2,1,1)), _MM_SHUFFLE(3,3,3,2)));
+		out += 24;
+	}
+	return col;
+}
+
+static int convertRowSIMD32(const uint8_t *raw, const uint32_t *rowColors, uint32_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i three = _mm_set1_epi32(3);
+	const __m128i c0 = _mm_set1_epi32(rowColors[0]);
+	const __m128i c1 = _mm_set1_epi32(rowColors[1]);
+	const __m128i c2 = _mm_set1_epi32(rowColors[2]);
+	const __m128i c3 = _mm_set1_epi32(rowColors[3]);
+	int col;
+
+	for(col=0; col+4<=VIDEO_WIDTH; col+=4)
+	{
+		__m128i idx;
+		__m128i p;
+		int32_t quad;
+
+		memcpy(&quad, raw+col, sizeof(quad));
+		idx = _mm_cvtsi32_si128(quad);
+		idx = _mm_and_si128(_mm_unpacklo_epi16(_mm_unpacklo_epi8(idx, zero), zero), three);
+		p = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(c0, _mm_cmpeq_epi32(idx, zero)), _mm_and_si128(c1, _mm_cmpeq_epi32(idx, _mm_set1_epi32(1)))),
+			_mm_or_si128(_mm_and_si128(c2, _mm_cmpeq_epi32(idx, _mm_set1_epi32(2))), _mm_and_si128(c3, _mm_cmpeq_epi32(idx, three))));
+
+		// p0 p0 p0 p1 | p1 p1 p2 p2 | p2 p3 p3 p3
+		_mm_storeu_si128((__m128i *)out,     _mm_shuffle_epi32(p, _MM_SHUFFLE(1,0,0,0)));
+		_mm_storeu_si128((__m128i *)out + 1, _mm_shuffle_epi32(p, _MM_SHUFFLE(2,2,1,1)));
+		_mm_storeu_si128((__m128i *)out + 2, _mm_shuffle_epi32(p, _MM_SHUFFLE(3,3,3,2)));
+		out += 12;
+	}
+	return col;
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+static int convertRowSIMD16(const uint8_t *raw, const uint32_t *rowColors, uint16_t *out)
+{
+	const uint16x8_t three = vdupq_n_u16(3);
+	const uint16x8_t c0 = vdupq_n_u16((uint16_t)rowColors[0]);
+	const uint16x8_t c1 = vdupq_n_u16((uint16_t)rowColors[1]);
+	const uint16x8_t c2 = vdupq_n_u16((uint16_t)rowColors[2]);
+	const uint16x8_t c3 = vdupq_n_u16((uint16_t)rowColors[3]);
+	int col;
+
+	for(col=0; col+8<=VIDEO_WIDTH; col+=8)
+	{
+		uint16x8_t idx = vandq_u16(vmovl_u8(vld1_u8(raw+col)), three);
+		uint16x8x3_t p;
+
+		p.val[0] = vbslq_u16(vceqq_u16(idx, vdupq_n_u16(0)), c0,
+			vbslq_u16(vceqq_u16(idx, vdupq_n_u16(1)), c1,
+			vbslq_u16(vceqq_u16(idx, vdupq_n_u16(2)), c2, c3)));
+		p.val[1] = p.val[0];
+		p.val[2] = p.val[0];
+		vst3q_u16(out, p); // interleaving three copies triples every pixel
+		out += 24;
+	}
+	return col;
+}
+
+static int convertRowSIMD32(const uint8_t *raw, const uint32_t *rowColors, uint32_t *out)
+{
+	const uint32x4_t three = vdupq_n_u32(3);
+	const uint32x4_t c0 = vdupq_n_u32(rowColors[0]);
+	const uint32x4_t c1 = vdupq_n_u32(rowColors[1]);
+	const uint32x4_t c2 = vdupq_n_u32(rowColors[2]);
+	const uint32x4_t c3 = vdupq_n_u32(rowColors[3]);
+	int col;
+
+	for(col=0; col+8<=VIDEO_WIDTH; col+=8)
+	{
+		uint16x8_t idx = vmovl_u8(vld1_u8(raw+col));
+		uint32x4_t half[2];
+		uint32x4x3_t p;
+		int i;
+
+		half[0] = vandq_u32(vmovl_u16(vget_low_u16(idx)), three);
+		half[1] = vandq_u32(vmovl_u16(vget_high_u16(idx)), three);
+		for(i=0; i<2; i++)
+		{
+			p.val[0] = vbslq_u32(vceqq_u32(half[i], vdupq_n_u32(0)), c0,
+				vbslq_u32(vceqq_u32(half[i], vdupq_n_u32(1)), c1,
+				vbslq_u32(vceqq_u32(half[i], vdupq_n_u32(2)), c2, c3)));
+			p.val[1] = p.val[0];
+			p.val[2] = p.val[0];
+			vst3q_u32(out, p);
+			out += 12;
+		}
+	}
+	return col;
+}
+
+#else
+
+static int convertRowSIMD16(const uint8_t *raw, const uint32_t *rowColors, uint16_t *out)
+{
+	return 0;
+}
+
+static int convertRowSIMD32(const uint8_t *raw, const uint32_t *rowColors, uint32_t *out)
+{
+	return 0;
+}
+
+#endif
+
+// 16 bit pixels, RGB565 and 0RGB1555
+
+static void convertRow1x16(const uint8_t *raw, const uint32_t *rowColors, void *frame)
+{
+	uint16_t *out = (uint16_t *)frame;
+	int col;
+
+	for(col=0; col<VIDEO_WIDTH; col++)
+	{
+		out[col] = (uint16_t)rowColors[raw[col]&0x3];
+	}
+}
+
+static void convertRow2x16(const uint8_t *raw, const uint32_t *rowColors, void *frame)
+{
+	uint16_t *out = (uint16_t *)frame;
+	int col;
+
+	for(col=0; col<VIDEO_WIDTH; col++)
+	{
+		uint16_t color = (uint16_t)rowColors[raw[col]&0x3];
+		out[0] = color;
+		out[1] = color;
+		out += 2;
+	}
+}
+
+static void convertRow3x16(const uint8_t *raw, const uint32_t *rowColors, void *frame)
+{
+	uint16_t *out = (uint16_t *)frame;
+	int col = convertRowSIMD16(raw, rowColors, out);
+
+	for(out+=col*3; col<VIDEO_WIDTH; col++)
+	{
+		uint16_t color = (uint16_t)rowColors[raw[col]&0x3];
+		out[0] = color;
+		out[1] = color;
+		out[2] = color;
+		out += 3;
+	}
+}
+
+// 32 bit pixels, XRGB8888
+
+static void convertRow1x32(const uint8_t *raw, const uint32_t *rowColors, void *frame)
+{
+	uint32_t *out = (uint32_t *)frame;
 	int col;
 
-	for(row=0; row<64; row++)
+	for(col=0; col<VIDEO_WIDTH; col++)
+	{
+		out[col] = rowColors[raw[col]&0x3];
+	}
+}
+
+static void convertRow2x32(const uint8_t *raw, const uint32_t *rowColors, void *frame)
+{
+	uint32_t *out = (uint32_t *)frame;
+	int col;
+
+	for(col=0; col<VIDEO_WIDTH; col++)
+	{
+		uint32_t color = rowColors[raw[col]&0x3];
+		out[0] = color;
+		out[1] = color;
+		out += 2;
+	}
+}
+
+static void convertRow3x32(const uint8_t *raw, const uint32_t *rowColors, void *frame)
+{
+	uint32_t *out = (uint32_t *)frame;
+	int col = convertRowSIMD32(raw, rowColors, out);
+
+	for(out+=col*3; col<VIDEO_WIDTH; col++)
+	{
+		uint32_t color = rowColors[raw[col]&0x3];
+		out[0] = color;
+		out[1] = color;
+		out[2] = color;
+		out += 3;
+	}
+}
+
+unsigned int VIDEO_pixelBytes(enum video_format format)
+{
+	return format == VIDEO_XRGB8888 ? 4 : 2;
+}
+
+uint32_t VIDEO_mapColor(enum video_format format, uint32_t rgb)
+{
+	uint32_t r = (rgb >> 16) & 0xff;
+	uint32_t g = (rgb >> 8) & 0xff;
+	uint32_t b = rgb & 0xff;
+
+	switch(format)
 	{
+		case VIDEO_0RGB1555: return RGB1555(r, g, b);
+		case VIDEO_RGB565: return RGB565(r, g, b);
+		default: return RGB8888(r, g, b);
+	}
+}
+
+void VIDEO_setOutput(struct channelf *ctx, enum video_format format, unsigned int scale)
+{
+	static void (* const convert16[3])(const uint8_t *, const uint32_t *, void *) = { convertRow1x16, convertRow2x16, convertRow3x16 };
+	static void (* const convert32[3])(const uint8_t *, const uint32_t *, void *) = { convertRow1x32, convertRow2x32, convertRow3x32 };
+
+	if(format >= VIDEO_FORMATS)
+		format = VIDEO_XRGB8888;
+	if(scale < 1 || scale > 3)
+		scale = 3;
+
+	ctx->VIDEO_Colors = colors[format];
+	ctx->VIDEO_PixelBytes = VIDEO_pixelBytes(format);
+	ctx->VIDEO_Scale = scale;
+	ctx->VIDEO_convertRow = ctx->VIDEO_PixelBytes == 4 ? convert32[scale-1] : convert16[scale-1];
+	VIDEO_invalidate(ctx);
+}
+
+uint64_t VIDEO_drawFrame(struct channelf *ctx, void *frame, unsigned int pitch, uint64_t rows)
+{
+	unsigned int scale = ctx->VIDEO_Scale;
+	size_t pitchBytes = (size_t)pitch * ctx->VIDEO_PixelBytes;
+	size_t lineBytes = (size_t)VIDEO_WIDTH * scale * ctx->VIDEO_PixelBytes;
+	unsigned int line;
+	int row;
+	int i;
+
+	rows |= ctx->VIDEO_Dirty;
+	for(row=0; row<VIDEO_HEIGHT; row++)
+	{
+		const uint8_t *raw = &ctx->VIDEO_Buffer_raw[row<<7];
+		uint8_t *out = (uint8_t *)frame + row*scale*pitchBytes;
+		uint32_t rowColors[4];
+		uint8_t pal;
+
+		if(!(rows & VIDEO_ROW(row)))
+		{
+			continue;
+		}
+
 		// The last three columns in the video buffer are special.
 		// 127 - unknown
 		// 126 - bit 1 = palette bit 1
 		// 125 - bit 1 = palette bit 0 (or with 126 bit 0)
 		// (palette is shifted by two and added to 'color'
 		//  to find palette index which holds the color's index)
-		
-		uint8_t pal = ((VIDEO_Buffer_raw[(row<<7)+125]&2)>>1) | (VIDEO_Buffer_raw[(row<<7)+126]&3);
+
+		pal = ((raw[125]&2)>>1) | (raw[126]&3);
 		pal = (pal<<2) & 0xC;
-		
-		for(col=0; col<128; col++)
+		for(i=0; i<4; i++)
+		{
+			rowColors[i] = ctx->VIDEO_Colors[palette[pal|i]&0x7];
+		}
+
+		ctx->VIDEO_convertRow(raw+VIDEO_FIRST_COL, rowColors, out);
+		for(line=1; line<scale; line++)
 		{
-			uint8_t color = (VIDEO_Buffer_raw[(row<<7)+col]) & 0x3;
-			VIDEO_Buffer_rgb[(row<<7)+col] = colors[palette[pal|color]&0x7];
+			memcpy(out+line*pitchBytes, out, lineBytes);
 		}
 	}
 
+	ctx->VIDEO_Dirty = 0;
+	return rows;
+}
+
+void VIDEO_invalidate(struct channelf *ctx)
+{
+	ctx->VIDEO_Dirty = ~(uint64_t)0;
 }
 
-void VIDEO_portReceive(uint8_t port, uint8_t val)
+void VIDEO_portReceive(struct channelf *ctx, uint8_t port, uint8_t val)
 {
 	switch(port)
 	{
 		case 0: // ARM 
 			val &= 0x60;
-			if(val==0x40 && VIDEO_ARM==0x60) // Strobed
+			if(val==0x40 && ctx->VIDEO_ARM==0x60) // Strobed
 			{
-				// Write to display buffer
-				VIDEO_Buffer_raw[(VIDEO_Y<<7)+VIDEO_X] = VIDEO_Color;
+				// Write to display buffer. A whole row is redrawn when
+				// any of it changes, which covers the palette columns.
+				uint8_t *pixel = &ctx->VIDEO_Buffer_raw[(ctx->VIDEO_Y<<7)+ctx->VIDEO_X];
+				if(*pixel!=ctx->VIDEO_Color)
+				{
+					*pixel = ctx->VIDEO_Color;
+					ctx->VIDEO_Dirty |= VIDEO_ROW(ctx->VIDEO_Y);
+					ctx->VIDEO_Written[ctx->VIDEO_Y] = ctx->STATE_Epoch;
+				}
 			}
-			VIDEO_ARM = val;
+			ctx->VIDEO_ARM = val;
 		break;
 
 		case 1: // Set Color (bits 6 and 7) 
-			VIDEO_Color = ((val ^ 0xFF)>>6)&3;
+			ctx->VIDEO_Color = ((val ^ 0xFF)>>6)&3;
 			break;
 		case 4: // X coordinate, inverted (bits 0-6)
-			VIDEO_X = (val ^ 0xFF) & 0x7F;
+			ctx->VIDEO_X = (val ^ 0xFF) & 0x7F;
 			break;
 		case 5: // Y coordinate, inverted (bits 0-5)
-			VIDEO_Y = (val ^ 0xFF) & 0x3F;
+			ctx->VIDEO_Y = (val ^ 0xFF) & 0x3F;
 			break;
 	}
 }
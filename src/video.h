@@ -19,29 +19,28 @@
 
 #include <stdint.h>
 
+struct channelf;
+
 // 128x64
 #define VIDEO_SIZE 8192
-extern uint8_t VIDEO_Buffer_raw[VIDEO_SIZE];
-extern uint8_t VIDEO_ARM;
-extern uint8_t VIDEO_X;
-extern uint8_t VIDEO_Y;
-extern uint8_t VIDEO_Color;
-
-void VIDEO_portReceive(uint8_t port, uint8_t val);
-
-void VIDEO_drawFrame(void);
-
-#ifdef USE_RGB565
-typedef uint16_t pixel_t;
-#if defined(ABGR1555)
-#define vRGB(r,g,b) ((((b) & 0xf8) << 7) | (((g) & 0xf8) << 2) | (((r) & 0xf8) >> 3))
-#else
-#define vRGB(r,g,b) ((((r) & 0xf8) << 8) | (((g) & 0xfc) << 3) | (((b) & 0xf8) >> 3))
-#endif
-#else
-typedef uint32_t pixel_t;
+
+// visible part of the buffer, columns 4-105 of all 64 rows
+#define VIDEO_FIRST_COL 4
+#define VIDEO_WIDTH 102
+#define VIDEO_HEIGHT 64
+
+// Output pixel formats, numbered as enum retro_pixel_format. The format
+// is picked at runtime, see VIDEO_setOutput.
+enum video_format
+{
+	VIDEO_0RGB1555 = 0,
+	VIDEO_XRGB8888 = 1,
+	VIDEO_RGB565   = 2,
+	VIDEO_FORMATS
+};
+
+// colors are given as 0xRRGGBB and mapped to the output format
 #define vRGB(r,g,b) (((r) << 16) | ((g) << 8) | (b))
-#endif
 
 #define BLACK vRGB(0,0,0)
 #define WHITE vRGB(0xff, 0xff, 0xff)
@@ -49,6 +48,26 @@ typedef uint32_t pixel_t;
 #define GRAY_CC vRGB(0xCC, 0xCC, 0xCC)
 #define GREEN vRGB(0, 0xff, 0)
 
-extern pixel_t VIDEO_Buffer_rgb[VIDEO_SIZE]; // 128x64
+#define VIDEO_ROW(row) ((uint64_t)1 << (row))
+
+void VIDEO_portReceive(struct channelf *ctx, uint8_t port, uint8_t val);
+
+// Pick the pixel format and scale (1, 2 or 3) VIDEO_drawFrame outputs,
+// along with the row converter for them. Every row is drawn again.
+void VIDEO_setOutput(struct channelf *ctx, enum video_format format, unsigned int scale);
+
+// bytes per pixel of format
+unsigned int VIDEO_pixelBytes(enum video_format format);
+
+// 0xRRGGBB color as a pixel of format
+uint32_t VIDEO_mapColor(enum video_format format, uint32_t rgb);
+
+// Draw the visible rows changed since the last call, and those set in
+// rows, into frame (pitch in pixels) in the format and scale picked by
+// VIDEO_setOutput. Returns the rows drawn as a bit per row.
+uint64_t VIDEO_drawFrame(struct channelf *ctx, void *frame, unsigned int pitch, uint64_t rows);
+
+// after VIDEO_Buffer_raw was changed directly, redraw every row
+void VIDEO_invalidate(struct channelf *ctx);
 
 #endif
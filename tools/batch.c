@@ -0,0 +1,550 @@
+/*
+	This file is part of FreeChaF.
+
+	FreeChaF is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	FreeChaF is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
+*/
+
+/*
+	Headless batch runner
+
+	Runs a list of carts for a fixed number of frames with scripted input
+	and records a hash of VRAM and of the audio buffer for every frame.
+	Jobs are spread over a pool of worker threads, each with its own
+	machine, and idle workers steal jobs from busy ones.
+
+	usage: freechaf_batch [options] [rom ...]
+
+	  -j n       worker threads (default 1)
+	  -n frames  frames per rom given on the command line (default 600)
+	  -i script  input script for roms given on the command line
+	  -f list    read jobs from a list file, one "rom frames [script]" per line
+	  -s dir     BIOS directory; HLE is used for any BIOS that is missing
+	  -o dir     directory for the per-frame hash files (default .)
+	  -c core    CPU core: switch or table (default switch)
+	  -x         clear the screen in a single frame (fast screen clear HLE)
+	  -t n       every n frames save a state, run a frame, reset and load the
+	             state again; the hashes match a run without -t when states
+	             are complete. An incremental save kept alongside has to
+	             match a full one each time, and the state hash has to be
+	             the same after loading, or the job stops.
+	  -v         print core log messages
+
+	Each job writes <dir>/<job>-<rom name>.txt with one "frame vram audio"
+	line per frame. When every job is done a summary line per job, in job
+	order, goes to stdout.
+
+	An input script holds "frame control state" lines. From that frame on
+	control 0 (console: TIME, MODE, HOLD, START in bits 0-3) or controller
+	1 or 2 (right, left, back, forward, rotate left, rotate right, pull, push
+	in bits 0-7) reads as state. "frame reset" presses the reset button.
+	Lines starting with # are ignored.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "libretro.h"
+#include "channelf.h"
+#include "memory.h"
+#include "f8.h"
+#include "audio.h"
+#include "video.h"
+#include "controller.h"
+#include "state.h"
+
+#define FRAME_WIDTH (VIDEO_WIDTH*3)
+#define FRAME_HEIGHT (VIDEO_HEIGHT*3)
+#define FNV_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+struct batch_input
+{
+	int frame;
+	int control; // -1 for reset
+	int state;
+};
+
+struct batch_job
+{
+	const char *rom;
+	const char *script;
+	int frames;
+
+	// results
+	int ok;
+	int framesRun;
+	uint64_t vram; // hash of the final frame
+	uint64_t audio; // hash over every frame's audio
+};
+
+struct batch_worker
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int *queue; // job indices, owner pops from tail, thieves take from head
+	int head;
+	int tail;
+	struct channelf *machine;
+	uint32_t *screen; // 3x upscaled XRGB8888 output, as retro_run draws it
+};
+
+// the core's frontend hooks; the batch runner has no frontend
+retro_environment_t Environ;
+retro_log_printf_t log_cb;
+
+static struct batch_job *Jobs;
+static int JobCount;
+static struct batch_worker *Workers;
+static int WorkerCount = 1;
+
+static const char *SystemDir;
+static const char *OutputDir = ".";
+static int Core = F8_CORE_SWITCH;
+static int FastClear;
+static int StateInterval; // -t, 0 for none
+static int Verbose;
+
+static bool batch_environ(unsigned cmd, void *data)
+{
+	return false;
+}
+
+static void batch_log(enum retro_log_level level, const char *fmt, ...)
+{
+	va_list va;
+
+	if (!Verbose)
+		return;
+
+	va_start(va, fmt);
+	vfprintf(stderr, fmt, va);
+	va_end(va);
+}
+
+static uint64_t hash(uint64_t h, const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	size_t i;
+
+	for(i=0; i<size; i++)
+	{
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static const char *baseName(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	const char *bslash = strrchr(path, '\\');
+
+	if (bslash > slash)
+		slash = bslash;
+	return slash ? slash+1 : path;
+}
+
+static int addJob(const char *rom, int frames, const char *script)
+{
+	struct batch_job *jobs = (struct batch_job *)realloc(Jobs, (JobCount+1) * sizeof(*Jobs));
+	if (!jobs)
+		return 0;
+
+	Jobs = jobs;
+	memset(&Jobs[JobCount], 0, sizeof(*Jobs));
+	Jobs[JobCount].rom = strdup(rom);
+	Jobs[JobCount].script = script ? strdup(script) : NULL;
+	Jobs[JobCount].frames = frames;
+	JobCount++;
+	return 1;
+}
+
+static int readJobList(const char *path)
+{
+	char line[1024];
+	char rom[1024];
+	char script[1024];
+	int frames;
+	int fields;
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+	{
+		fprintf(stderr, "can't open job list %s\n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), f))
+	{
+		fields = sscanf(line, "%1023s %d %1023s", rom, &frames, script);
+		if (fields < 2 || rom[0]=='#')
+			continue;
+		if (!addJob(rom, frames, fields==3 ? script : NULL))
+		{
+			fclose(f);
+			return 0;
+		}
+	}
+	fclose(f);
+	return 1;
+}
+
+static struct batch_input *readScript(const char *path, int *count)
+{
+	char line[256];
+	char control[16];
+	struct batch_input *inputs = NULL;
+	struct batch_input *grown;
+	int state;
+	int frame;
+	int fields;
+	FILE *f;
+
+	*count = 0;
+	if (!path)
+		return NULL;
+
+	f = fopen(path, "r");
+	if (!f)
+	{
+		fprintf(stderr, "can't open input script %s\n", path);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), f))
+	{
+		fields = sscanf(line, "%d %15s %i", &frame, control, &state);
+		if (fields < 2 || line[0]=='#')
+			continue;
+
+		grown = (struct batch_input *)realloc(inputs, (*count+1) * sizeof(*inputs));
+		if (!grown)
+			break;
+		inputs = grown;
+
+		inputs[*count].frame = frame;
+		if (strcmp(control, "reset") == 0)
+		{
+			inputs[*count].control = -1;
+			inputs[*count].state = 0;
+		}
+		else
+		{
+			inputs[*count].control = atoi(control);
+			inputs[*count].state = fields==3 ? state : 0;
+		}
+		(*count)++;
+	}
+	fclose(f);
+	return inputs;
+}
+
+static void loadBIOS(struct channelf *ctx)
+{
+	char path[1024];
+
+	ctx->hle_state.psu1_hle = true;
+	ctx->hle_state.psu2_hle = true;
+	if (!SystemDir)
+		return;
+
+	snprintf(path, sizeof(path), "%s/sl90025.bin", SystemDir);
+	if (MEMORY_loadSysROM_libretro(ctx, path, 0))
+		ctx->hle_state.psu1_hle = false;
+	else
+	{
+		snprintf(path, sizeof(path), "%s/sl31253.bin", SystemDir);
+		if (MEMORY_loadSysROM_libretro(ctx, path, 0))
+			ctx->hle_state.psu1_hle = false;
+	}
+
+	snprintf(path, sizeof(path), "%s/sl31254.bin", SystemDir);
+	if (MEMORY_loadSysROM_libretro(ctx, path, 0x400))
+		ctx->hle_state.psu2_hle = false;
+}
+
+// same order as retro_run
+static void runFrame(struct channelf *ctx)
+{
+	if(ctx->hle_state.psu1_hle || ctx->hle_state.psu2_hle || ctx->hle_state.fast_screen_clear)
+		CHANNELF_HLE_run(ctx);
+	else
+		CHANNELF_run(ctx);
+}
+
+static void runJob(struct channelf *ctx, uint32_t *screen, int index)
+{
+	struct batch_job *job = &Jobs[index];
+	struct batch_input *inputs;
+	int inputCount;
+	int next = 0;
+	int frame;
+	uint64_t vram;
+	uint64_t audio;
+	char path[1024];
+	FILE *out;
+	uint8_t *state = NULL; // saved state, incremental save, full save
+	size_t stateSize = 0;
+	uint32_t mark = 0;
+	uint64_t stateHash;
+
+	CHANNELF_init(ctx);
+	ctx->F8_Core = Core;
+	ctx->hle_state.fast_screen_clear = FastClear;
+	loadBIOS(ctx);
+
+	if (!MEMORY_loadCartFile(ctx, job->rom))
+	{
+		fprintf(stderr, "can't load %s\n", job->rom);
+		CHANNELF_deinit(ctx);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s/%04d-%s.txt", OutputDir, index, baseName(job->rom));
+	out = fopen(path, "w");
+	if (!out)
+	{
+		fprintf(stderr, "can't write %s\n", path);
+		CHANNELF_deinit(ctx);
+		return;
+	}
+
+	inputs = readScript(job->script, &inputCount);
+	job->audio = FNV_BASIS;
+
+	if (StateInterval)
+	{
+		stateSize = STATE_size(ctx);
+		state = (uint8_t *)malloc(stateSize * 3);
+	}
+
+	for(frame=0; frame<job->frames; frame++)
+	{
+		if (state && frame % StateInterval == 0)
+		{
+			stateHash = STATE_hash(ctx);
+			if (!STATE_save(ctx, NULL, state, stateSize))
+				break;
+			STATE_saveDirty(ctx, NULL, state + stateSize, stateSize, &mark);
+			STATE_saveFixed(ctx, NULL, state + stateSize*2, stateSize);
+			if (memcmp(state + stateSize, state + stateSize*2, stateSize))
+			{
+				fprintf(stderr, "%s: incremental state differs at frame %d\n", job->rom, frame);
+				break;
+			}
+			runFrame(ctx);
+			CHANNELF_reset(ctx);
+			if (!STATE_load(ctx, NULL, state, stateSize))
+				break;
+			if (STATE_hash(ctx) != stateHash)
+			{
+				fprintf(stderr, "%s: state hash differs after loading at frame %d\n", job->rom, frame);
+				break;
+			}
+		}
+
+		for(; next<inputCount && inputs[next].frame<=frame; next++)
+		{
+			if (inputs[next].control < 0)
+				CHANNELF_reset(ctx);
+			else
+				CONTROLLER_setInput(ctx, inputs[next].control, inputs[next].state);
+		}
+
+		runFrame(ctx);
+
+		audio = hash(FNV_BASIS, ctx->AUDIO_Buffer, ctx->AUDIO_Samples * 2 * sizeof(int16_t));
+		VIDEO_drawFrame(ctx, screen, FRAME_WIDTH, 0);
+		vram = hash(FNV_BASIS, ctx->VIDEO_Buffer_raw, sizeof(ctx->VIDEO_Buffer_raw));
+
+		fprintf(out, "%d %016llx %016llx\n", frame, (unsigned long long)vram, (unsigned long long)audio);
+		job->vram = vram;
+		job->audio = hash(job->audio, &audio, sizeof(audio));
+	}
+
+	fclose(out);
+	free(inputs);
+	free(state);
+	CHANNELF_deinit(ctx);
+
+	job->framesRun = frame;
+	job->ok = frame == job->frames;
+}
+
+static int takeJob(struct batch_worker *self)
+{
+	struct batch_worker *victim;
+	int job = -1;
+	int i;
+
+	pthread_mutex_lock(&self->lock);
+	if (self->tail > self->head)
+		job = self->queue[--self->tail];
+	pthread_mutex_unlock(&self->lock);
+	if (job >= 0)
+		return job;
+
+	// own queue is empty, steal the oldest job of another worker
+	for(i=1; i<WorkerCount && job<0; i++)
+	{
+		victim = &Workers[(self - Workers + i) % WorkerCount];
+		pthread_mutex_lock(&victim->lock);
+		if (victim->tail > victim->head)
+			job = victim->queue[victim->head++];
+		pthread_mutex_unlock(&victim->lock);
+	}
+	return job;
+}
+
+static void *worker(void *arg)
+{
+	struct batch_worker *self = (struct batch_worker *)arg;
+	int job;
+
+	while ((job = takeJob(self)) >= 0)
+		runJob(self->machine, self->screen, job);
+	return NULL;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: freechaf_batch [-j threads] [-n frames] [-i script] [-f list]\n"
+		"                      [-s biosdir] [-o outdir] [-c switch|table] [-x] [-t n] [-v] [rom ...]\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *script = NULL;
+	int frames = 600;
+	int failed = 0;
+	int i;
+
+	for(i=1; i<argc; i++)
+	{
+		if (argv[i][0]!='-')
+			addJob(argv[i], frames, script);
+		else if (strcmp(argv[i], "-x") == 0)
+			FastClear = 1;
+		else if (strcmp(argv[i], "-v") == 0)
+			Verbose = 1;
+		else if (i+1 >= argc)
+		{
+			usage();
+			return 1;
+		}
+		else if (strcmp(argv[i], "-j") == 0)
+			WorkerCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-n") == 0)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-i") == 0)
+			script = argv[++i];
+		else if (strcmp(argv[i], "-s") == 0)
+			SystemDir = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0)
+			OutputDir = argv[++i];
+		else if (strcmp(argv[i], "-t") == 0)
+			StateInterval = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-f") == 0)
+		{
+			if (!readJobList(argv[++i]))
+				return 1;
+		}
+		else if (strcmp(argv[i], "-c") == 0)
+		{
+			i++;
+			if (strcmp(argv[i], "switch") == 0)
+				Core = F8_CORE_SWITCH;
+			else if (strcmp(argv[i], "table") == 0)
+				Core = F8_CORE_TABLE;
+			else
+			{
+				usage();
+				return 1;
+			}
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	if (JobCount == 0)
+	{
+		usage();
+		return 1;
+	}
+	if (WorkerCount < 1)
+		WorkerCount = 1;
+	if (WorkerCount > JobCount)
+		WorkerCount = JobCount;
+
+	Environ = batch_environ;
+	log_cb = batch_log;
+	F8_init();
+
+	Workers = (struct batch_worker *)calloc(WorkerCount, sizeof(*Workers));
+	if (!Workers)
+		return 1;
+
+	for(i=0; i<WorkerCount; i++)
+	{
+		Workers[i].queue = (int *)malloc(JobCount * sizeof(int));
+		Workers[i].machine = (struct channelf *)malloc(sizeof(struct channelf));
+		Workers[i].screen = (uint32_t *)malloc(FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t));
+		if (!Workers[i].queue || !Workers[i].machine || !Workers[i].screen)
+			return 1;
+		pthread_mutex_init(&Workers[i].lock, NULL);
+	}
+
+	// deal the jobs out round robin, owners run theirs last-in first-out
+	for(i=JobCount-1; i>=0; i--)
+	{
+		struct batch_worker *w = &Workers[i % WorkerCount];
+		w->queue[w->tail++] = i;
+	}
+
+	for(i=1; i<WorkerCount; i++)
+		pthread_create(&Workers[i].thread, NULL, worker, &Workers[i]);
+	worker(&Workers[0]);
+	for(i=1; i<WorkerCount; i++)
+		pthread_join(Workers[i].thread, NULL);
+
+	for(i=0; i<JobCount; i++)
+	{
+		if (Jobs[i].ok)
+			printf("%04d %s %d %016llx %016llx\n", i, Jobs[i].rom, Jobs[i].framesRun,
+				(unsigned long long)Jobs[i].vram, (unsigned long long)Jobs[i].audio);
+		else
+		{
+			printf("%04d %s failed\n", i, Jobs[i].rom);
+			failed++;
+		}
+	}
+
+	for(i=0; i<WorkerCount; i++)
+	{
+		pthread_mutex_destroy(&Workers[i].lock);
+		free(Workers[i].queue);
+		free(Workers[i].machine);
+		free(Workers[i].screen);
+	}
+	free(Workers);
+
+	return failed ? 2 : 0;
+}
@@ -0,0 +1,542 @@
+/*
+	This file is part of FreeChaF.
+
+	FreeChaF is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	FreeChaF is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with FreeChaF.  If not, see http://www.gnu.org/licenses/
+*/
+
+/*
+	Benchmark driver
+
+	Loads a cart through the libretro API, runs it for a fixed number of
+	frames with scripted input and reports the speed of the core along
+	with the host time spent in each part of retro_run. Built with
+	FREECHAF_PROFILE by make bench.
+
+	usage: freechaf_bench [options] rom
+
+	  -n frames  frames to run (default 3600)
+	  -s dir     BIOS directory; without it the BIOS is emulated (HLE)
+	  -c core    CPU core: switch or table (default switch)
+	  -x         clear the screen in a single frame
+	  -z scale   video output scale: 1x, 2x or 3x (default 3x)
+	  -r rate    audio sample rate: 32000, 44100 or 48000 (default 44100)
+	  -k mode    frameskip: disabled, auto or threshold (default disabled)
+	  -b percent audio buffer occupancy reported to the core (default 100),
+	             below 25 an underrun is reported likely
+	  -w kb      record rewind frames in a buffer of kb KB (default off)
+	  -a frames  run ahead this many frames, as RetroArch does in a single
+	             instance (default 0)
+	  -g frames  log the state hash every this many frames, seen with -v
+	  -f         lend the core a framebuffer to draw into
+	  -p format  accept only this pixel format: xrgb8888, rgb565 or 0rgb1555
+	  -i script  input script
+	  -o file    write the JSON report to file instead of stdout
+	  -v         print core log messages
+
+	An input script holds "frame port buttons" lines. From that frame on
+	the retropad on port 0 or 1 holds the buttons set in the buttons mask,
+	bit n being RETRO_DEVICE_ID_JOYPAD_n (B=0, Y=1, SELECT=2, START=3, UP=4,
+	DOWN=5, LEFT=6, RIGHT=7, A=8, X=9). Lines starting with # are ignored.
+
+	The same cart, options and script always run the same frames, and the
+	report carries hashes of the last frame, of all audio and of the
+	machine state at the end so runs of different builds can be checked
+	against each other.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "libretro.h"
+#include "channelf.h"
+#include "video.h"
+#include "profile.h"
+
+#define CLOCKS_PER_TICK 2 // F8 clock periods per tick, 1.7897725 MHz
+#define FNV_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define FREECHAF_MEMORY_STATE_HASH 0x102 // as in libretro.c
+
+struct bench_input
+{
+	int frame;
+	int port;
+	unsigned buttons;
+};
+
+static const char *RomPath;
+static const char *SystemDir;
+static const char *CoreName = "switch";
+static const char *Scale = "3x";
+static const char *Rate = "44100";
+static const char *Frameskip = "disabled";
+static unsigned Occupancy = 100;
+static const char *RewindBuffer = NULL;
+static int RunAhead;
+static const char *StateHashLog = "disabled";
+static int AVEnable = 3; // answer to GET_AUDIO_VIDEO_ENABLE, video and audio
+static int SavestateContext = RETRO_SAVESTATE_CONTEXT_NORMAL;
+static retro_audio_buffer_status_callback_t BufferStatus;
+static int NullFrames; // dupes and skipped frames
+static int FastClear;
+static int LendFramebuffer;
+static int OnlyFormat = -1; // -p, any format when negative
+static enum retro_pixel_format Format = RETRO_PIXEL_FORMAT_0RGB1555; // until the core sets one
+static int Verbose;
+
+static struct bench_input *Inputs;
+static int InputCount;
+static int NextInput;
+static unsigned Buttons[2];
+static int Frame;
+
+// the last frame, hashed once the run is over
+static const uint8_t *VideoData;
+static unsigned VideoWidth;
+static unsigned VideoHeight;
+static size_t VideoPitch;
+
+// framebuffer lent with -f, as wide as the largest output
+static uint32_t Framebuffer[VIDEO_WIDTH*3 * VIDEO_HEIGHT*3];
+
+static uint64_t AudioHash = FNV_BASIS;
+
+static uint64_t hash(uint64_t h, const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	size_t i;
+
+	for(i=0; i<size; i++)
+	{
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static void bench_log(enum retro_log_level level, const char *fmt, ...)
+{
+	va_list va;
+
+	if (!Verbose)
+		return;
+
+	va_start(va, fmt);
+	vfprintf(stderr, fmt, va);
+	va_end(va);
+}
+
+static bool bench_environ(unsigned cmd, void *data)
+{
+	struct retro_variable *var;
+	struct retro_framebuffer *fb;
+
+	switch(cmd)
+	{
+		case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+			((struct retro_log_callback *)data)->log = bench_log;
+			return true;
+		case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+			// a file holds no BIOS files, so without -s the cart
+			// itself stands in for the directory and HLE is used
+			*(const char **)data = SystemDir ? SystemDir : RomPath;
+			return true;
+		case RETRO_ENVIRONMENT_GET_VARIABLE:
+			var = (struct retro_variable *)data;
+			if (strcmp(var->key, "freechaf_fast_scrclr") == 0)
+				var->value = FastClear ? "enabled" : "disabled";
+			else if (strcmp(var->key, "freechaf_cpu_core") == 0)
+				var->value = CoreName;
+			else if (strcmp(var->key, "freechaf_video_scale") == 0)
+				var->value = Scale;
+			else if (strcmp(var->key, "freechaf_audio_rate") == 0)
+				var->value = Rate;
+			else if (strcmp(var->key, "freechaf_frameskip") == 0)
+				var->value = Frameskip;
+			else if (strcmp(var->key, "freechaf_rewind") == 0)
+				var->value = RewindBuffer ? "enabled" : "disabled";
+			else if (strcmp(var->key, "freechaf_rewind_buffer") == 0 && RewindBuffer)
+				var->value = RewindBuffer;
+			else if (strcmp(var->key, "freechaf_state_hash") == 0)
+				var->value = StateHashLog;
+			else
+				return false;
+			return true;
+		case RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER:
+			fb = (struct retro_framebuffer *)data;
+			if (!LendFramebuffer || fb->width > VIDEO_WIDTH*3 || fb->height > VIDEO_HEIGHT*3)
+				return false;
+			fb->data = Framebuffer;
+			fb->pitch = VIDEO_WIDTH*3 * VIDEO_pixelBytes((enum video_format)Format);
+			fb->format = Format;
+			fb->memory_flags = 0;
+			return true;
+		case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+			if (OnlyFormat >= 0 && *(enum retro_pixel_format *)data != (enum retro_pixel_format)OnlyFormat)
+				return false;
+			Format = *(enum retro_pixel_format *)data;
+			return true;
+		case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+			*(bool *)data = true;
+			return true;
+		case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+			*(int *)data = AVEnable;
+			return true;
+		case RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT:
+			*(int *)data = SavestateContext;
+			return true;
+		case RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK:
+			BufferStatus = data ? ((struct retro_audio_buffer_status_callback *)data)->callback : NULL;
+			return true;
+		case RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY:
+		case RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS:
+		case RETRO_ENVIRONMENT_SET_VARIABLES:
+		case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
+			return true;
+	}
+	return false;
+}
+
+static void bench_video(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+	if (!data) // dupe
+	{
+		NullFrames++;
+		return;
+	}
+
+	VideoData = (const uint8_t *)data;
+	VideoWidth = width;
+	VideoHeight = height;
+	VideoPitch = pitch;
+}
+
+static uint64_t videoHash(void)
+{
+	uint64_t h = FNV_BASIS;
+	size_t bytes = VideoWidth * VIDEO_pixelBytes((enum video_format)Format); // visible part of each line
+	unsigned y;
+
+	for(y=0; y<VideoHeight; y++)
+	{
+		h = hash(h, VideoData + y * VideoPitch, bytes);
+	}
+	return h;
+}
+
+static void bench_audio(int16_t left, int16_t right)
+{
+}
+
+static size_t bench_audio_batch(const int16_t *data, size_t frames)
+{
+	AudioHash = hash(AudioHash, data, frames * 2 * sizeof(int16_t));
+	return frames;
+}
+
+static void bench_input_poll(void)
+{
+	for(; NextInput<InputCount && Inputs[NextInput].frame<=Frame; NextInput++)
+	{
+		Buttons[Inputs[NextInput].port] = Inputs[NextInput].buttons;
+	}
+}
+
+static int16_t bench_input_state(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+	if (port > 1 || device != RETRO_DEVICE_JOYPAD)
+		return 0;
+	return (Buttons[port] >> id) & 1;
+}
+
+// One frame shown with RunAhead frames run ahead of it. The frame that
+// counts is run without video and its state saved, the ones after it
+// without audio, all but the last without video either, and the state
+// is loaded again. Its audio is what a run without run-ahead gives.
+static void runAhead(void *state, size_t size)
+{
+	int i;
+
+	AVEnable = 2;
+	retro_run();
+	SavestateContext = RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE;
+	retro_serialize(state, size);
+	SavestateContext = RETRO_SAVESTATE_CONTEXT_NORMAL;
+	for(i=0; i<RunAhead; i++)
+	{
+		AVEnable = i == RunAhead-1 ? 1 : 0;
+		retro_run();
+	}
+	SavestateContext = RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE;
+	retro_unserialize(state, size);
+	SavestateContext = RETRO_SAVESTATE_CONTEXT_NORMAL;
+	AVEnable = 3;
+}
+
+static int readScript(const char *path)
+{
+	char line[256];
+	struct bench_input *grown;
+	int frame;
+	int port;
+	unsigned buttons;
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+	{
+		fprintf(stderr, "can't open input script %s\n", path);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), f))
+	{
+		if (line[0]=='#' || sscanf(line, "%d %d %i", &frame, &port, &buttons) != 3)
+			continue;
+		if (port < 0 || port > 1)
+			continue;
+
+		grown = (struct bench_input *)realloc(Inputs, (InputCount+1) * sizeof(*Inputs));
+		if (!grown)
+		{
+			fclose(f);
+			return 0;
+		}
+		Inputs = grown;
+		Inputs[InputCount].frame = frame;
+		Inputs[InputCount].port = port;
+		Inputs[InputCount].buttons = buttons;
+		InputCount++;
+	}
+	fclose(f);
+	return 1;
+}
+
+static void writeString(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for(; *s; s++)
+	{
+		if (*s=='"' || *s=='\\')
+			fputc('\\', out);
+		fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+// indexed by enum retro_pixel_format
+static const char *FormatNames[VIDEO_FORMATS] = { "0rgb1555", "xrgb8888", "rgb565" };
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: freechaf_bench [-n frames] [-s biosdir] [-c switch|table] [-x]\n"
+		"                      [-z 1x|2x|3x] [-r rate] [-k frameskip] [-b percent] [-w kb]\n"
+		"                      [-a frames] [-g frames] [-f] [-p format] [-i script]\n"
+		"                      [-o report.json] [-v] rom\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const char *sectionNames[PROFILE_SECTIONS] = { "cpu", "audio", "video", "osd", "state" };
+	struct retro_game_info game;
+	struct retro_system_av_info av;
+	const char *script = NULL;
+	const char *report = NULL;
+	void *state = NULL; // run-ahead state
+	size_t stateSize = 0;
+	int frames = 3600;
+	uint64_t start;
+	uint64_t total = 0;
+	uint64_t other;
+	uint64_t video = 0;
+	uint64_t machine = 0;
+	const uint8_t *stateHash;
+	double seconds;
+	FILE *out = stdout;
+	int i;
+
+	for(i=1; i<argc; i++)
+	{
+		if (argv[i][0]!='-')
+			RomPath = argv[i];
+		else if (strcmp(argv[i], "-x") == 0)
+			FastClear = 1;
+		else if (strcmp(argv[i], "-v") == 0)
+			Verbose = 1;
+		else if (strcmp(argv[i], "-f") == 0)
+			LendFramebuffer = 1;
+		else if (i+1 >= argc)
+		{
+			usage();
+			return 1;
+		}
+		else if (strcmp(argv[i], "-n") == 0)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-s") == 0)
+			SystemDir = argv[++i];
+		else if (strcmp(argv[i], "-c") == 0)
+			CoreName = argv[++i];
+		else if (strcmp(argv[i], "-z") == 0)
+			Scale = argv[++i];
+		else if (strcmp(argv[i], "-r") == 0)
+			Rate = argv[++i];
+		else if (strcmp(argv[i], "-k") == 0)
+			Frameskip = argv[++i];
+		else if (strcmp(argv[i], "-b") == 0)
+			Occupancy = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-w") == 0)
+			RewindBuffer = argv[++i];
+		else if (strcmp(argv[i], "-a") == 0)
+			RunAhead = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-g") == 0)
+			StateHashLog = argv[++i];
+		else if (strcmp(argv[i], "-p") == 0)
+		{
+			i++;
+			for(OnlyFormat=0; OnlyFormat<VIDEO_FORMATS; OnlyFormat++)
+				if (strcmp(argv[i], FormatNames[OnlyFormat]) == 0)
+					break;
+			if (OnlyFormat == VIDEO_FORMATS)
+			{
+				usage();
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-i") == 0)
+			script = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0)
+			report = argv[++i];
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	if (!RomPath || frames < 1 || RunAhead < 0)
+	{
+		usage();
+		return 1;
+	}
+	if (script && !readScript(script))
+		return 1;
+
+	retro_set_environment(bench_environ);
+	retro_set_video_refresh(bench_video);
+	retro_set_audio_sample(bench_audio);
+	retro_set_audio_sample_batch(bench_audio_batch);
+	retro_set_input_poll(bench_input_poll);
+	retro_set_input_state(bench_input_state);
+	retro_init();
+
+	memset(&game, 0, sizeof(game));
+	game.path = RomPath;
+	if (!retro_load_game(&game))
+	{
+		fprintf(stderr, "can't load %s\n", RomPath);
+		return 1;
+	}
+	retro_get_system_av_info(&av);
+	if (RunAhead)
+	{
+		stateSize = retro_serialize_size();
+		state = malloc(stateSize);
+		if (!state)
+			return 1;
+	}
+
+	memset(&Profile, 0, sizeof(Profile));
+	for(Frame=0; Frame<frames; Frame++)
+	{
+		if (BufferStatus)
+			BufferStatus(true, Occupancy, Occupancy < 25);
+		start = PROFILE_now();
+		if (RunAhead)
+			runAhead(state, stateSize);
+		else
+			retro_run();
+		total += PROFILE_now() - start;
+	}
+
+	if (VideoData)
+		video = videoHash();
+	stateHash = (const uint8_t *)retro_get_memory_data(FREECHAF_MEMORY_STATE_HASH);
+	for(i=0; i<8; i++)
+		machine = (machine << 8) | stateHash[i];
+	retro_unload_game();
+	retro_deinit();
+
+	other = total;
+	for(i=0; i<PROFILE_SECTIONS; i++)
+		other -= Profile.ns[i];
+	seconds = total / 1e9;
+
+	if (report)
+	{
+		out = fopen(report, "w");
+		if (!out)
+		{
+			fprintf(stderr, "can't write %s\n", report);
+			return 1;
+		}
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"rom\": ");
+	writeString(out, RomPath);
+	fprintf(out, ",\n");
+	fprintf(out, "\t\"bios\": %s,\n", SystemDir ? "true" : "false");
+	fprintf(out, "\t\"core\": ");
+	writeString(out, CoreName);
+	fprintf(out, ",\n");
+	fprintf(out, "\t\"fast_screen_clear\": %s,\n", FastClear ? "true" : "false");
+	fprintf(out, "\t\"scale\": ");
+	writeString(out, Scale);
+	fprintf(out, ",\n");
+	fprintf(out, "\t\"framebuffer\": %s,\n", LendFramebuffer ? "true" : "false");
+	fprintf(out, "\t\"pixel_format\": \"%s\",\n", FormatNames[Format]);
+	fprintf(out, "\t\"sample_rate\": %.0f,\n", av.timing.sample_rate);
+	fprintf(out, "\t\"frameskip\": ");
+	writeString(out, Frameskip);
+	fprintf(out, ",\n");
+	fprintf(out, "\t\"buffer_occupancy\": %u,\n", Occupancy);
+	fprintf(out, "\t\"rewind_kb\": %s,\n", RewindBuffer ? RewindBuffer : "0");
+	fprintf(out, "\t\"runahead\": %d,\n", RunAhead);
+	fprintf(out, "\t\"null_frames\": %d,\n", NullFrames);
+	fprintf(out, "\t\"frames\": %d,\n", frames);
+	fprintf(out, "\t\"host_seconds\": %.6f,\n", seconds);
+	fprintf(out, "\t\"fps\": %.2f,\n", frames / seconds);
+	fprintf(out, "\t\"realtime\": %.2f,\n", frames / seconds / av.timing.fps);
+	fprintf(out, "\t\"emulated_mhz\": %.3f,\n", (double)frames * (RunAhead + 1) * TICKS_PER_FRAME * CLOCKS_PER_TICK / seconds / 1e6);
+	fprintf(out, "\t\"instructions\": %llu,\n", (unsigned long long)Profile.instructions);
+	fprintf(out, "\t\"ns_per_instruction\": %.3f,\n", Profile.instructions ? (double)Profile.ns[PROFILE_CPU] / Profile.instructions : 0.0);
+	fprintf(out, "\t\"ms\": {\n");
+	for(i=0; i<PROFILE_SECTIONS; i++)
+		fprintf(out, "\t\t\"%s\": %.3f,\n", sectionNames[i], Profile.ns[i] / 1e6);
+	fprintf(out, "\t\t\"other\": %.3f,\n", other / 1e6);
+	fprintf(out, "\t\t\"total\": %.3f\n", total / 1e6);
+	fprintf(out, "\t},\n");
+	fprintf(out, "\t\"video_hash\": \"%016llx\",\n", (unsigned long long)video);
+	fprintf(out, "\t\"audio_hash\": \"%016llx\",\n", (unsigned long long)AudioHash);
+	fprintf(out, "\t\"state_hash\": \"%016llx\"\n", (unsigned long long)machine);
+	fprintf(out, "}\n");
+
+	if (out != stdout)
+		fclose(out);
+	free(Inputs);
+	free(state);
+	return 0;
+}